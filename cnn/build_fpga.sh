@@ -5,13 +5,16 @@ tools_setup -t A10DS
 # Move to project directory
 cd ~/lab1/
 
+# Kernel settings, the host must be built with the same (see kernel_flags.sh)
+source ./kernel_flags.sh
+
 # Check Arria 10 PAC card connectivity
 aocl diagnose
 error_check
 
 # Running project in FPGA Hardware Mode (this takes approximately 1 hour)
-printf "\\n%s\\n" "Running in FPGA Hardware Mode:"
-aoc device/cnn.cl -o bin/cnn.aocx -board=pac_a10
+printf "\\n%s\\n" "Running in FPGA Hardware Mode:$AOC_FLAGS"
+aoc $AOC_FLAGS device/cnn.cl -o bin/cnn.aocx -board=pac_a10
 
 # Availability of Acceleration cards
 aoc -list-boards
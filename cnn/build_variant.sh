@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# Build a kernel specialized for one layer shape as bin/<prefix>.aocx and
+# record it in bin/cnn_variants.txt, the manifest the host selects
+# kernels from (see host/inc/variants643.h).
+#
+# Usage: ./build_variant.sh <prefix> [emulator|fpga] [KEY=value ...]
+#   K S R C M N G       fixed layer sizes, G groups
+#   TR TC TM TN TB      fixed tile sizes
+#   ACT WTS EXACT       layouts and exact tiles, must match the host build
+#   ENGINE              0 direct, 1 line buffer (S=1 only)
+#   ORDER               tile loop order, e.g. ORDER=to,ti,row,col
+# Sizes that are not given are read at run time.
+#
+# Example: ./build_variant.sh cnn_conv3 fpga K=3 S=1 R=13 C=13 M=384 N=256 TR=13 TC=13 TM=8 TN=8
+
+PREFIX=$1
+TARGET=emulator
+shift
+if [ "$1" == "emulator" ] || [ "$1" == "fpga" ]; then
+    TARGET=$1
+    shift
+fi
+if [ -z "$PREFIX" ]; then
+    echo "usage: $0 <prefix> [emulator|fpga] [KEY=value ...]"
+    exit 1
+fi
+
+# Initial Setup
+source /data/intel_fpga/devcloudLoginToolSetup.sh
+tools_setup -t A10DS
+
+# Move to project directory
+cd "$(dirname "$0")"
+
+# Every size defaults to run time, the settings given below fix it
+declare -A SIZE=( [K]=K_WTS [S]=S_WTS [R]=R_OFM [C]=C_OFM [M]=M_OFM [N]=N_IFM [G]=G_GRP
+                  [TR]=TR [TC]=TC [TM]=TM [TN]=TN [TB]=TB )
+declare -A FIX=( [K]=FIX_K [S]=FIX_S [R]=FIX_R [C]=FIX_C [M]=FIX_M [N]=FIX_N [G]=FIX_G
+                 [TR]=FIX_TR [TC]=FIX_TC [TM]=FIX_TM [TN]=FIX_TN [TB]=FIX_TB )
+declare -A FIXED
+FLAGS=""
+for kv in "$@"; do
+    key=${kv%%=*}
+    value=${kv#*=}
+    if [ -n "${SIZE[$key]}" ]; then
+        FLAGS="$FLAGS -D${FIX[$key]}=1 -D${SIZE[$key]}=$value"
+        FIXED[$key]=1
+    elif [ "$key" == "ACT" ]; then
+        FLAGS="$FLAGS -DACT_LAYOUT=$value"
+    elif [ "$key" == "WTS" ]; then
+        FLAGS="$FLAGS -DWTS_LAYOUT=$value"
+    elif [ "$key" == "EXACT" ]; then
+        FLAGS="$FLAGS -DEXACT_TILES=$value"
+    elif [ "$key" == "ENGINE" ]; then
+        FLAGS="$FLAGS -DCONV_ENGINE=$value"
+    elif [ "$key" == "ORDER" ]; then
+        FLAGS="$FLAGS -DLOOP_ORDER=$value"
+    else
+        echo "unknown setting $kv"
+        exit 1
+    fi
+done
+for key in "${!FIX[@]}"; do
+    if [ -z "${FIXED[$key]}" ]; then
+        FLAGS="$FLAGS -D${FIX[$key]}=0"
+    fi
+done
+# Zero padding is always read at run time
+FLAGS="$FLAGS -DFIX_P=0"
+
+if [ "$TARGET" == "fpga" ]; then
+    AOC_TARGET="-board=pac_a10"
+else
+    AOC_TARGET="-march=emulator"
+fi
+
+mkdir -p bin
+printf "\\n%s\\n" "Building $PREFIX ($TARGET):$FLAGS"
+aoc $AOC_TARGET $FLAGS device/cnn.cl -o bin/$PREFIX.aocx || exit 1
+
+# Replace any previous entry for this prefix
+MANIFEST=bin/cnn_variants.txt
+touch $MANIFEST
+grep -v "^$PREFIX[[:space:]]" $MANIFEST > $MANIFEST.tmp
+echo "$PREFIX $*" >> $MANIFEST.tmp
+mv $MANIFEST.tmp $MANIFEST
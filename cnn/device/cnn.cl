@@ -44,57 +44,444 @@
 #include "../host/inc/instance643.h"
 #include "../host/inc/kernel643.h"
 
-__attribute((reqd_work_group_size(1, 1, 1)))
-__kernel void cnn(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
-                  const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params)
+// Body of the cnn compute units, see NUM_CU in kernel643.h
+void cnn_unit(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+              const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params)
 {
-  uint64_t iter;
+  uint64_t b, iter;
   uint64_t row, col, to, ti;
 
   uint64_t _K_wts = FIX_K ? K_WTS : layer_params.K_wts;
   uint64_t _S_wts = FIX_S ? S_WTS : layer_params.S_wts;
   
-  uint64_t _R_ofm = FIX_R ? R_OFM : layer_params.R_ofm;
-  uint64_t _C_ofm = FIX_C ? C_OFM : layer_params.C_ofm;
-  uint64_t _M_ofm = FIX_M ? M_OFM : layer_params.M_ofm;
+  uint64_t _R_ofm = FIX_R ? DEV_R_OFM : layer_params.R_ofm;
+  uint64_t _C_ofm = FIX_C ? DEV_C_OFM : layer_params.C_ofm;
+  uint64_t _M_ofm = FIX_M ? DEV_M_OFM : layer_params.M_ofm;
+
+  // Taps in the zero halo read nothing from input, see layer_size
+  uint64_t _P_top = FIX_P ? P_TOP : layer_params.pad_top;
+  uint64_t _P_left = FIX_P ? P_LEFT : layer_params.pad_left;
+
+  uint64_t _R_ifm = (_R_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_top);
+  uint64_t _C_ifm = (_C_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_left);
+  uint64_t _N_ifm = FIX_N ? DEV_N_IFM : layer_params.N_ifm;
 
-  uint64_t _R_ifm = (_R_ofm * _S_wts + _K_wts - _S_wts);
-  uint64_t _C_ifm = (_C_ofm * _S_wts + _K_wts - _S_wts);
-  uint64_t _N_ifm = FIX_N ? N_IFM : layer_params.N_ifm;
+  // Grouped layers: the ti loops cover the input channels of one group,
+  // those of output channel too start at (too / _Mg) * _Ng.  A group of
+  // _Ng < _Tn channels leaves the other ti lanes idle, so a depthwise
+  // layer uses 1 of _Tn (see the MAC utilization in the host report)
+  uint64_t _G = FIX_G ? G_GRP : layer_params.groups;
+  uint64_t _Mg = _M_ofm / _G;
+  uint64_t _Ng = _N_ifm / _G;
+
+  // This instance's output channels; weights and outputs are the whole
+  // tensors, indexed by channel like in a single instance
+  uint64_t _M_first = layer_params.m_first;
+  uint64_t _M_end = layer_params.m_end;
+
+  // and its images, from image b_first of the buffers
+  input += SIZEi(layer_params.b_first, _N_ifm, _R_ifm, _C_ifm);
+  output += SIZEo(layer_params.b_first, _M_ofm, _R_ofm, _C_ofm);
   
   uint64_t _Tr = FIX_TR ? TR : kernel_params.Tr;
   uint64_t _Tc = FIX_TC ? TC : kernel_params.Tc;
   uint64_t _Tm = FIX_TM ? TM : kernel_params.Tm;
   uint64_t _Tn = FIX_TN ? TN : kernel_params.Tn;
+  uint64_t _Tb = FIX_TB ? TB : kernel_params.Tb;
  
+#if CONV_ENGINE == ENGINE_LINEBUF
+  // Line-buffer engine (S_wts == 1, see kernel643.h).  For each (to, ti)
+  // tile the input channels are streamed row by row, each pixel read
+  // from DDR once.  line_buf keeps the last LB_MAX_K rows of every
+  // channel and win the last LB_MAX_K columns of those rows; a K < LB_MAX_K
+  // window sits in their bottom right corner at offset ko.
+  cnndata_t line_buf[LB_MAX_TN][LB_MAX_K][LB_MAX_C];
+  cnndata_t win[LB_MAX_TN][LB_MAX_K][LB_MAX_K];
+  cnndata_t wbuf[LB_MAX_TM][LB_MAX_TN][LB_MAX_K][LB_MAX_K];
+  uint64_t ko = LB_MAX_K - _K_wts;
+
   for(iter = 0; iter < batch_size; iter++) {
+    for(to = _M_first; to < _M_end; to += _Tm) {
+      for(ti = 0; ti < _N_ifm; ti += _Tn) {
+        uint64_t r, c, too, tii, i, j;
+
+        for(too = to; too < TILE_END(to, _Tm, _M_end); too++)
+          for(tii = ti; tii < TILE_END(ti, _Tn, _N_ifm); tii++)
+            for(i = 0; i < _K_wts; i++)
+              for(j = 0; j < _K_wts; j++)
+                wbuf[too - to][tii - ti][i][j] = ARRAYw(weights, too, tii, i, j, _M_ofm, _N_ifm, _K_wts, _K_wts);
+
+        for(r = 0; r < _R_ifm; r++) {
+          for(c = 0; c < _C_ifm; c++) {
+            for(tii = ti; tii < TILE_END(ti, _Tn, _N_ifm); tii++) {
+              uint64_t t = tii - ti;
+
+              #pragma unroll
+              for(i = 0; i < LB_MAX_K - 1; i++)
+                line_buf[t][i][c] = line_buf[t][i + 1][c];
+              line_buf[t][LB_MAX_K - 1][c] = ARRAYi(input, iter, tii, r, c, batch_size, _N_ifm, _R_ifm, _C_ifm);
+
+              #pragma unroll
+              for(i = 0; i < LB_MAX_K; i++) {
+                #pragma unroll
+                for(j = 0; j < LB_MAX_K - 1; j++)
+                  win[t][i][j] = win[t][i][j + 1];
+                win[t][i][LB_MAX_K - 1] = line_buf[t][i][c];
+              }
+            }
+
+            // The window is complete once K rows and K columns are in
+            // and every output pixel is read and written once per ti tile;
+            // the sum keeps the (tii, i, j) order of the direct loop nest
+            if (r + 1 >= _K_wts && c + 1 >= _K_wts) {
+              for(too = to; too < TILE_END(to, _Tm, _M_end); too++) {
+                cnndata_t acc = ARRAYo(output, iter, too, r + 1 - _K_wts, c + 1 - _K_wts, batch_size, _M_ofm, _R_ofm, _C_ofm);
+                for(tii = ti; tii < TILE_END(ti, _Tn, _N_ifm); tii++)
+                  for(i = 0; i < _K_wts; i++)
+                    for(j = 0; j < _K_wts; j++)
+                      acc += wbuf[too - to][tii - ti][i][j] * win[tii - ti][ko + i][ko + j];
+                ARRAYo(output, iter, too, r + 1 - _K_wts, c + 1 - _K_wts, batch_size, _M_ofm, _R_ofm, _C_ofm) = acc;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+#else
+  // Tile loops, nested in LOOP_ORDER (see kernel643.h)
+#define FOR_row for(row = 0; row < _R_ofm; row += _Tr)
+#define FOR_col for(col = 0; col < _C_ofm ; col += _Tc)
+#define FOR_to  for(to = _M_first; to < _M_end; to += _Tm)
+#define FOR_ti  for(ti = 0; ti < _Ng; ti += _Tn)
+
+  // Images are taken _Tb at a time and the batch loop sits inside the
+  // tile loops, so each weight tile is fetched once per _Tb images
+  for(b = 0; b < batch_size; b += _Tb) {
     
-    for(row = 0; row < _R_ofm; row += _Tr) {
-      for(col = 0; col < _C_ofm ; col += _Tc) {
-        for(to = 0; to < _M_ofm; to += _Tm) {
-          for(ti = 0; ti < _N_ifm; ti += _Tn) {
-            uint64_t trr, tcc, too, tii;
-  
-            for(trr = row; trr < MIN(row + _Tr, _R_ofm); trr++){
-              for(tcc = col; tcc < MIN(col + _Tc, _C_ofm); tcc++){
-                for(too = to; too < MIN(to + _Tm, _M_ofm); too++) {    
-                  for(tii = ti; tii < MIN(ti + _Tn, _N_ifm); tii++) { 
-                    uint64_t i, j;
-                    for(i = 0; i < _K_wts; i++){
-                      for(j = 0; j < _K_wts; j++){
-                        ARRAYo(output, iter, too, trr, tcc, batch_size, _M_ofm, _R_ofm, _C_ofm)+=
-                          ARRAYw(weights, too, tii, i, j, _M_ofm, _N_ifm, _K_wts, _K_wts) *
-                          ARRAYi(input, iter, tii, _S_wts * trr + i, _S_wts * tcc + j, 
-                            batch_size, _N_ifm, _R_ifm, _C_ifm);
-                      }
-                    }
+    TILE_LOOPS(LOOP_ORDER) {
+      for(iter = b; iter < MIN(b + _Tb, batch_size); iter++) {
+        uint64_t trr, tcc, too, tii;
+
+        for(trr = row; trr < TILE_END(row, _Tr, _R_ofm); trr++){
+          for(tcc = col; tcc < TILE_END(col, _Tc, _C_ofm); tcc++){
+            for(too = to; too < TILE_END(to, _Tm, _M_end); too++) {    
+              for(tii = ti; tii < TILE_END(ti, _Tn, _Ng); tii++) { 
+                uint64_t i, j;
+                for(i = 0; i < _K_wts; i++){
+                  for(j = 0; j < _K_wts; j++){
+                    // above or left of the image the unsigned row and column wrap past the end
+                    uint64_t ir = _S_wts * trr + i - _P_top, ic = _S_wts * tcc + j - _P_left;
+                    ARRAYo(output, iter, too, trr, tcc, batch_size, _M_ofm, _R_ofm, _C_ofm)+=
+                      ARRAYw(weights, too, tii, i, j, _M_ofm, _Ng, _K_wts, _K_wts) *
+                      (ir < _R_ifm && ic < _C_ifm ? ARRAYi(input, iter, (too / _Mg) * _Ng + tii, ir, ic, 
+                        batch_size, _N_ifm, _R_ifm, _C_ifm) : 0);
                   }
                 }
               }
             }
-          } 
-        } 
-      } 
+          }
+        }
+      }
+    }
+  }
+#endif
+}
+
+// Compute unit u is the kernel cnn_<u>, unit 0 keeps the name cnn
+#define CNN_KERNEL(name) \
+__attribute((reqd_work_group_size(1, 1, 1))) \
+__kernel void name(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, \
+                   const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params) \
+{ \
+  cnn_unit(input, weights, output, batch_size, kernel_params, layer_params); \
+}
+
+CNN_KERNEL(cnn)
+#if NUM_CU > 1
+CNN_KERNEL(cnn_1)
+#endif
+#if NUM_CU > 2
+CNN_KERNEL(cnn_2)
+#endif
+#if NUM_CU > 3
+CNN_KERNEL(cnn_3)
+#endif
+
+#if GEMM_BS > 0
+/*
+ * Convolution lowered to GEMM: output[m][p] = sum_k weights[m][k] *
+ * input[k][p] per image, with input the im2col matrix (k = (ti, i, j),
+ * p = (row, col)) and weights in the reference MNKK order.  Each k step
+ * is a GEMM_BS x GEMM_BS outer product, so blocks at the matrix edges
+ * are the only ones with idle MACs.
+ */
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_gemm(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+                       const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params)
+{
+  uint64_t iter, m0, p0, k, mm, pp;
+
+  uint64_t _M = layer_params.M_ofm;
+  uint64_t _R = layer_params.R_ofm;
+  uint64_t _C = layer_params.C_ofm;
+  uint64_t _P = _R * _C;
+  uint64_t _Kd = layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts;
+
+  for(iter = 0; iter < batch_size; iter++) {
+    for(m0 = 0; m0 < _M; m0 += GEMM_BS) {
+      for(p0 = 0; p0 < _P; p0 += GEMM_BS) {
+        cnndata_t acc[GEMM_BS][GEMM_BS];
+
+        #pragma unroll
+        for(mm = 0; mm < GEMM_BS; mm++)
+          #pragma unroll
+          for(pp = 0; pp < GEMM_BS; pp++)
+            acc[mm][pp] = 0;
+
+        for(k = 0; k < _Kd; k++) {
+          cnndata_t a[GEMM_BS], x[GEMM_BS];
+
+          #pragma unroll
+          for(mm = 0; mm < GEMM_BS; mm++)
+            a[mm] = m0 + mm < _M ? weights[(m0 + mm) * _Kd + k] : 0;
+          #pragma unroll
+          for(pp = 0; pp < GEMM_BS; pp++)
+            x[pp] = p0 + pp < _P ? input[(iter * _Kd + k) * _P + p0 + pp] : 0;
+
+          #pragma unroll
+          for(mm = 0; mm < GEMM_BS; mm++)
+            #pragma unroll
+            for(pp = 0; pp < GEMM_BS; pp++)
+              acc[mm][pp] += a[mm] * x[pp];
+        }
+
+        for(mm = 0; mm < MIN((uint64_t)GEMM_BS, _M - m0); mm++)
+          for(pp = 0; pp < MIN((uint64_t)GEMM_BS, _P - p0); pp++)
+            ARRAYo(output, iter, m0 + mm, (p0 + pp) / _C, (p0 + pp) % _C, batch_size, _M, _R, _C) = acc[mm][pp];
+      }
+    }
+  }
+}
+#endif
+
+#if PW_BQ > 0
+/*
+ * Pointwise and fully-connected layers as one matrix product over the
+ * batch: output[m][q] = sum_k weights[m][k] * input[k][q] with
+ * k = (ti, i, j) and q = (image, row, col), read in place from the
+ * device layouts.  Each k step is a PW_BM x PW_BQ outer product.
+ */
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_pointwise(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+                            const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params)
+{
+  uint64_t m0, q0, k, mm, qq;
+
+  uint64_t _K_wts = layer_params.K_wts;
+  uint64_t _S_wts = layer_params.S_wts;
+  uint64_t _R_ofm = layer_params.R_ofm;
+  uint64_t _C_ofm = layer_params.C_ofm;
+  uint64_t _M_ofm = layer_params.M_ofm;
+  uint64_t _N_ifm = layer_params.N_ifm;
+  uint64_t _P_top = layer_params.pad_top;
+  uint64_t _P_left = layer_params.pad_left;
+  uint64_t _R_ifm = (_R_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_top);
+  uint64_t _C_ifm = (_C_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_left);
+
+  uint64_t _P = _R_ofm * _C_ofm;
+  uint64_t _Q = batch_size * _P;
+  uint64_t _Kd = _N_ifm * _K_wts * _K_wts;
+
+  for(m0 = 0; m0 < _M_ofm; m0 += PW_BM) {
+    for(q0 = 0; q0 < _Q; q0 += PW_BQ) {
+      cnndata_t acc[PW_BM][PW_BQ];
+
+      #pragma unroll
+      for(mm = 0; mm < PW_BM; mm++)
+        #pragma unroll
+        for(qq = 0; qq < PW_BQ; qq++)
+          acc[mm][qq] = 0;
+
+      for(k = 0; k < _Kd; k++) {
+        uint64_t ti = k / (_K_wts * _K_wts), i = k / _K_wts % _K_wts, j = k % _K_wts;
+        cnndata_t a[PW_BM], x[PW_BQ];
+
+        #pragma unroll
+        for(mm = 0; mm < PW_BM; mm++)
+          a[mm] = m0 + mm < _M_ofm ? ARRAYw(weights, m0 + mm, ti, i, j, _M_ofm, _N_ifm, _K_wts, _K_wts) : 0;
+        #pragma unroll
+        for(qq = 0; qq < PW_BQ; qq++) {
+          uint64_t q = q0 + qq, p = q % _P;
+          uint64_t ir = _S_wts * (p / _C_ofm) + i - _P_top, ic = _S_wts * (p % _C_ofm) + j - _P_left;
+          x[qq] = q < _Q && ir < _R_ifm && ic < _C_ifm ? ARRAYi(input, q / _P, ti, ir, ic,
+                                  batch_size, _N_ifm, _R_ifm, _C_ifm) : 0;
+        }
+
+        #pragma unroll
+        for(mm = 0; mm < PW_BM; mm++)
+          #pragma unroll
+          for(qq = 0; qq < PW_BQ; qq++)
+            acc[mm][qq] += a[mm] * x[qq];
+      }
+
+      for(mm = 0; mm < MIN((uint64_t)PW_BM, _M_ofm - m0); mm++) {
+        for(qq = 0; qq < MIN((uint64_t)PW_BQ, _Q - q0); qq++) {
+          uint64_t q = q0 + qq, p = q % _P;
+          ARRAYo(output, q / _P, m0 + mm, p / _C_ofm, p % _C_ofm, batch_size, _M_ofm, _R_ofm, _C_ofm) = acc[mm][qq];
+        }
+      }
+    }
+  }
+}
+#endif
+
+#if ZRLE > 0
+/*
+ * Zero run-length transport, see zrle643.h for the packed format.
+ * cnn_unzrle expands n packed elements into dst, cnn_zrle packs n
+ * elements of src; the host reads back the count and masks first and
+ * then only the nonzero values.
+ */
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_unzrle(__global const uint* restrict packed, __global cnndata_t* restrict dst, const uint64_t n)
+{
+  __global const cnndata_t *vals = (__global const cnndata_t*)(packed + 1 + CEIL_DIV(n, ZRLE_BLOCK));
+  uint64_t blk, k, v = 0;
+
+  for(blk = 0; blk < CEIL_DIV(n, ZRLE_BLOCK); blk++) {
+    uint mask = packed[1 + blk];
+    #pragma unroll
+    for(k = 0; k < ZRLE_BLOCK; k++) {
+      if (blk * ZRLE_BLOCK + k < n) {
+        dst[blk * ZRLE_BLOCK + k] = (mask >> k) & 1 ? vals[v] : 0;
+        v += (mask >> k) & 1;
+      }
+    }
+  }
+}
+
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_zrle(__global const cnndata_t* restrict src, __global uint* restrict packed, const uint64_t n)
+{
+  __global cnndata_t *vals = (__global cnndata_t*)(packed + 1 + CEIL_DIV(n, ZRLE_BLOCK));
+  uint64_t blk, k, v = 0;
+
+  for(blk = 0; blk < CEIL_DIV(n, ZRLE_BLOCK); blk++) {
+    uint mask = 0;
+    #pragma unroll
+    for(k = 0; k < ZRLE_BLOCK; k++) {
+      if (blk * ZRLE_BLOCK + k < n && src[blk * ZRLE_BLOCK + k] != 0) {
+        vals[v++] = src[blk * ZRLE_BLOCK + k];
+        mask |= 1u << k;
+      }
+    }
+    packed[1 + blk] = mask;
+  }
+  packed[0] = v;
+}
+#endif
+
+#if SP_BN > 0
+/*
+ * Block-sparse weights, see wts_to_blocks in layout643.h.  Each output
+ * channel walks only its kept SP_BN-channel blocks.  A block is applied
+ * to the whole output plane before the next one, in ascending channel
+ * order, so every output sums its taps in the order of the dense loops.
+ */
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_sparse(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+                         const uint64_t batch_size,  const kernel_size kernel_params, const layer_size layer_params)
+{
+  uint64_t iter, to, b, row, col, nn, i, j;
+
+  uint64_t _K_wts = layer_params.K_wts;
+  uint64_t _S_wts = layer_params.S_wts;
+  uint64_t _R_ofm = layer_params.R_ofm;
+  uint64_t _C_ofm = layer_params.C_ofm;
+  uint64_t _M_ofm = layer_params.M_ofm;
+  uint64_t _N_ifm = layer_params.N_ifm;
+  uint64_t _P_top = layer_params.pad_top;
+  uint64_t _P_left = layer_params.pad_left;
+  uint64_t _R_ifm = (_R_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_top);
+  uint64_t _C_ifm = (_C_ofm * _S_wts + _K_wts - _S_wts - 2 * _P_left);
+  uint64_t _Mg = _M_ofm / layer_params.groups;
+  uint64_t _Ng = _N_ifm / layer_params.groups;
+
+  __global const uint *blk_ptr = (__global const uint*)weights;
+  __global const uint *blk_col = blk_ptr + _M_ofm + 1;
+  __global const cnndata_t *blk_val = weights + _M_ofm + 1 + blk_ptr[_M_ofm];
+
+  for(iter = 0; iter < batch_size; iter++) {
+    for(to = 0; to < _M_ofm; to++) {
+      for(b = blk_ptr[to]; b < blk_ptr[to + 1]; b++) {
+        uint64_t n0 = blk_col[b] * SP_BN;
+        __global const cnndata_t *w = &blk_val[b * SP_BN * _K_wts * _K_wts];
+
+        for(row = 0; row < _R_ofm; row++) {
+          for(col = 0; col < _C_ofm; col++) {
+            cnndata_t acc = ARRAYo(output, iter, to, row, col, batch_size, _M_ofm, _R_ofm, _C_ofm);
+            #pragma unroll
+            for(nn = 0; nn < SP_BN; nn++) {
+              for(i = 0; i < _K_wts; i++) {
+                for(j = 0; j < _K_wts; j++) {
+                  uint64_t ir = _S_wts * row + i - _P_top, ic = _S_wts * col + j - _P_left;
+                  if (n0 + nn < _Ng && ir < _R_ifm && ic < _C_ifm)
+                    acc += w[(nn * _K_wts + i) * _K_wts + j] *
+                           ARRAYi(input, iter, (to / _Mg) * _Ng + n0 + nn, ir, ic, batch_size, _N_ifm, _R_ifm, _C_ifm);
+                }
+              }
+            }
+            ARRAYo(output, iter, to, row, col, batch_size, _M_ofm, _R_ofm, _C_ofm) = acc;
+          }
+        }
+      }
     }
   }
 }
+#endif
+
+#if JOB_TABLE > 0
+// Runs the num_jobs descriptors of jobs in order
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_jobs(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+                       const uint64_t num_jobs, const kernel_size kernel_params, __global const cnn_job* restrict jobs)
+{
+  uint64_t j;
+
+  for(j = 0; j < num_jobs; j++) {
+    cnn_job job = jobs[j];
+
+    cnn_unit(input + job.input_offset, weights + job.weight_offset, output + job.output_offset,
+             job.batch_size, kernel_params, job.layer);
+  }
+}
+#endif
+
+#if JOBQ > 0
+// Runs the jobs posted to the ring until a stop job.  ring[0] is the
+// doorbell, the number of jobs posted, and ring[1] the number done; job
+// j sits in slot j % JOBQ of jobs, JOB_WORDS words each.
+__attribute((reqd_work_group_size(1, 1, 1)))
+__kernel void cnn_persistent(__global const cnndata_t* restrict input, __global const cnndata_t* restrict weights, __global cnndata_t* restrict output, 
+                             __global volatile const uint64_t* jobs, const kernel_size kernel_params, __global volatile uint64_t* ring)
+{
+  uint64_t next, w;
+
+  for(next = 0; ; next++) {
+    cnn_job job;
+
+    while(ring[0] == next)
+      ;
+    for(w = 0; w < JOB_WORDS; w++)
+      ((uint64_t*)&job)[w] = jobs[(next % JOBQ) * JOB_WORDS + w];
+    if (job.batch_size == 0)
+      break;
+
+    cnn_unit(input + job.input_offset, weights + job.weight_offset, output + job.output_offset,
+             job.batch_size, kernel_params, job.layer);
+    mem_fence(CLK_GLOBAL_MEM_FENCE);
+    ring[1] = next + 1;
+  }
+}
+#endif
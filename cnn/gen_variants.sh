@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Build one cnn kernel per tile loop order (see LOOP_ORDER in
+# host/inc/kernel643.h) as bin/cnn_<order>.aocx, and optionally run the
+# host on every variant.  The native target compiles the kernels into
+# one host per order instead, bin/host_<order>, run with -native; it
+# builds them as the simulated-device host (make sim), so it needs no
+# SDK.
+#
+# Usage: ./gen_variants.sh [emulator|fpga|native] [run]
+#   AOC_FLAGS  extra aoc flags beyond the build variables
+#   HOST_ARGS  extra host arguments for the run step
+# The kernels and hosts take the build variables of the Makefile from
+# the environment (see kernel_flags.sh), e.g.
+# ACT_LAYOUT=2 ./gen_variants.sh emulator run.  LOOP_ORDER is set per
+# variant.
+
+TARGET=${1:-emulator}
+RUN=$2
+
+# Initial Setup, the native hosts build without the SDK
+if [ "$TARGET" != "native" ]; then
+    source /data/intel_fpga/devcloudLoginToolSetup.sh
+    tools_setup -t A10DS
+fi
+
+# Move to project directory
+cd "$(dirname "$0")"
+
+# Kernel settings, the host is built with the same
+unset LOOP_ORDER
+source ./kernel_flags.sh
+
+if [ "$TARGET" == "fpga" ]; then
+    AOC_TARGET="-board=pac_a10"
+elif [ "$TARGET" == "native" ]; then
+    HOST_ARGS="-native $HOST_ARGS"
+else
+    AOC_TARGET="-march=emulator"
+    HOST_ARGS="-emulator $HOST_ARGS"
+fi
+
+LOOPS="row col to ti"
+ORDERS=""
+for a in $LOOPS; do
+    for b in $LOOPS; do
+        for c in $LOOPS; do
+            for d in $LOOPS; do
+                if [ $(printf "%s\n" $a $b $c $d | sort -u | wc -l) -eq 4 ]; then
+                    ORDERS="$ORDERS $a,$b,$c,$d"
+                fi
+            done
+        done
+    done
+done
+
+mkdir -p bin
+for order in $ORDERS; do
+    printf "\\n%s\\n" "Building loop order $order ($TARGET):"
+    if [ "$TARGET" == "native" ]; then
+        # The kernels are part of the host, so every order is a host of
+        # its own, rebuilt as the order is not a file it depends on
+        rm -f bin/host_${order//,/_}
+        make sim SIM=host_${order//,/_} LOOP_ORDER=$order || exit 1
+    else
+        aoc $AOC_TARGET $AOC_FLAGS -DLOOP_ORDER=$order device/cnn.cl -o bin/cnn_${order//,/_}.aocx || exit 1
+    fi
+done
+
+if [ "$RUN" == "run" ]; then
+    HOST=host
+    if [ "$TARGET" != "native" ]; then
+        make || exit 1
+    fi
+    for order in $ORDERS; do
+        printf "\\n%s\\n" "Running loop order $order:"
+        if [ "$TARGET" == "native" ]; then
+            HOST=host_${order//,/_}
+        fi
+        ./bin/$HOST -order=$order $HOST_ARGS | grep -E "Results correct|not match|FPGA CNN exec time|modeled DDR traffic" | sort | uniq -c
+    done
+fi
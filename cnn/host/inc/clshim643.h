@@ -0,0 +1,63 @@
+#ifndef CLSHIM643_H
+#define CLSHIM643_H
+
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Just enough OpenCL C for g++ to compile device/cnn.cl into the host
+ * (see native643.h).  Include it right before cnn.cl and nowhere else,
+ * the address space qualifiers disappear and the attributes are
+ * dropped.
+ *
+ */
+
+#define __kernel
+#define __global
+#define __local
+#define __constant const
+#define restrict __restrict__
+#define __attribute(x)
+
+typedef unsigned int uint;
+
+// Every work-item of a native kernel is the calling thread
+#define CLK_GLOBAL_MEM_FENCE 0
+#define mem_fence(flags) __sync_synchronize()
+
+#endif
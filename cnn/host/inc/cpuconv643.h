@@ -0,0 +1,60 @@
+#ifndef CPUCONV643_H
+#define CPUCONV643_H
+
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Multithreaded CPU convolution engine for co-execution with the
+ * device (-cpu).  It works on the device tensors in place, indexed like
+ * cnn.cl through ARRAYi/ARRAYw/ARRAYo, so the host can hand any images
+ * or output channels of a chunk to either side.
+ *
+ */
+#include "util643.h"
+#include "instance643.h"
+#include "kernel643.h"
+
+// Adds the convolution of batch images of input into output channels
+// [layer->m_first, layer->m_end) of output, like one cnn launch.  The
+// pointers address the first image; weights hold all layer->M_ofm
+// channels.  Work is split across the host threads.
+void cpu_conv(const cnndata_t *input, const cnndata_t *weights, cnndata_t *output, uint64_t batch,
+              const layer_size *layer);
+
+#endif
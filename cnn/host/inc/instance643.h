@@ -47,40 +47,79 @@ typedef float cnndata_t;
 
 #define BATCH_SIZE 10
 
+/*
+ * Each size can be overridden with -D, which build_variant.sh uses to
+ * build kernels specialized for other layers.
+ */
 #if 1
 /* 
  * weights parameters
  */
+#ifndef K_WTS
 #define K_WTS (3) // weight width and height (square)
                    // same depth as output
+#endif
+#ifndef S_WTS
 #define S_WTS (1) // sliding stride
+#endif
 
 /* 
  * output feature map paramters
  */
+#ifndef R_OFM
 #define R_OFM (13) // height
+#endif
+#ifndef C_OFM
 #define C_OFM (13) // width
+#endif
+#ifndef M_OFM
 #define M_OFM (128) // depth
+#endif
 
 /*
  * input feature map paramters
  */
+#ifndef N_IFM
 #define N_IFM (192) // depth
+#endif
 
 #else
 
+#ifndef K_WTS
 #define K_WTS (4) // weight width and height (square)
+#endif
+#ifndef S_WTS
 #define S_WTS (1) // sliding stride
+#endif
 
+#ifndef R_OFM
 #define R_OFM (16) // height
+#endif
+#ifndef C_OFM
 #define C_OFM (16) // width
+#endif
+#ifndef M_OFM
 #define M_OFM (128) // depth
+#endif
 
+#ifndef N_IFM
 #define N_IFM (128) // depth
+#endif
 
 #endif
 
-#define R_IFM (R_OFM*S_WTS+K_WTS-S_WTS) // derived height
-#define C_IFM (C_OFM*S_WTS+K_WTS-S_WTS) // derived width
+#ifndef G_GRP
+#define G_GRP (1) // groups, divides M_OFM and N_IFM
+#endif
+
+#ifndef P_TOP
+#define P_TOP (0) // zero rows above and below the input
+#endif
+#ifndef P_LEFT
+#define P_LEFT (0) // zero columns left and right of the input
+#endif
+
+#define R_IFM (R_OFM*S_WTS+K_WTS-S_WTS-2*P_TOP) // derived height
+#define C_IFM (C_OFM*S_WTS+K_WTS-S_WTS-2*P_LEFT) // derived width
 
 #endif
@@ -46,37 +46,329 @@
 
 typedef unsigned int index_t;
 
+// Settings below can be overridden with -D, see build_variant.sh
+#ifndef FIX_R
 #define FIX_R (1) // output row
+#endif
+#ifndef FIX_C
 #define FIX_C (1) // output column
+#endif
+#ifndef FIX_M
 #define FIX_M (1) // output dept
+#endif
+#ifndef FIX_N
 #define FIX_N (1) // input depth
+#endif
+#ifndef FIX_K
 #define FIX_K (1) // weights
+#endif
+#ifndef FIX_S
 #define FIX_S (1) // stride
+#endif
+#ifndef FIX_G
+#define FIX_G (1) // groups
+#endif
+#ifndef FIX_P
+#define FIX_P (1) // zero padding
+#endif
 
+#ifndef FIX_TR
 #define FIX_TR (1) // output row
+#endif
+#ifndef FIX_TC
 #define FIX_TC (1) // output column
+#endif
+#ifndef FIX_TM
 #define FIX_TM (1) // output depth
+#endif
+#ifndef FIX_TN
 #define FIX_TN (1) // input depth
+#endif
+#ifndef FIX_TB
+#define FIX_TB (0) // batch, chosen by the host per layer
+#endif
 
 #if 1
 // blocked
+#ifndef TR
 #define TR (4) // output row
+#endif
+#ifndef TC
 #define TC (4) // output column
+#endif
+#ifndef TM
 #define TM (4) // output depth
+#endif
+#ifndef TN
 #define TN (4) // input depth
+#endif
+#ifndef TB
+#define TB (1) // batch
+#endif
 #else
 // flat
+#ifndef TR
 #define TR R_OFM // output row
+#endif
+#ifndef TC
 #define TC C_OFM // output column
+#endif
+#ifndef TM
 #define TM M_OFM // output depth
+#endif
+#ifndef TN
 #define TN N_IFM  // input depth
 #endif
+#ifndef TB
+#define TB (1) // batch
+#endif
+#endif
+
+/*
+ * Tile loop order.  LOOP_ORDER names the four tile loops of cnn.cl,
+ * outermost first, e.g. -DLOOP_ORDER=to,ti,row,col on the aoc line.
+ * gen_variants.sh builds one kernel per permutation and the host picks
+ * one with -order=.  The host depends on LOOP_ORDER only through
+ * WLAYOUT_PACKED, whose tiles follow the to/ti nesting (WPACK_TI_OUTER).
+ */
+#ifndef LOOP_ORDER
+#define LOOP_ORDER row,col,to,ti
+#endif
+#define TILE_LOOPS_(a,b,c,d) FOR_##a FOR_##b FOR_##c FOR_##d
+#define TILE_LOOPS(order) TILE_LOOPS_(order)
+// "a,b,c,d" of an order, e.g. for the native kernels the host runs
+#define TILE_ORDER_STR_(...) #__VA_ARGS__
+#define TILE_ORDER_STR(order) TILE_ORDER_STR_(order)
+// Level of loop l (LOOP_ROW..LOOP_TI in variants643.h) in an order, 0 outermost
+#define LOOP_ID_row 0
+#define LOOP_ID_col 1
+#define LOOP_ID_to  2
+#define LOOP_ID_ti  3
+#define LOOP_LEVEL_(l,a,b,c,d) (LOOP_ID_##a == (l) ? 0 : LOOP_ID_##b == (l) ? 1 : LOOP_ID_##c == (l) ? 2 : 3)
+#define LOOP_LEVEL(l,order) LOOP_LEVEL_(l,order)
+#define WPACK_TI_OUTER (LOOP_LEVEL(LOOP_ID_ti, LOOP_ORDER) < LOOP_LEVEL(LOOP_ID_to, LOOP_ORDER))
+
+/*
+ * Convolution engine compiled into cnn.cl.  The line-buffer engine
+ * handles stride 1 only; it streams each input row once per (to, ti)
+ * tile through on-chip line buffers of LB_MAX_TN x LB_MAX_K rows of up
+ * to LB_MAX_C pixels, and keeps LB_MAX_TM x LB_MAX_TN weight windows.
+ * The host checks the layer against these bounds.
+ */
+#define ENGINE_DIRECT  (0) // blocked loop nest of Zhang et al.
+#define ENGINE_LINEBUF (1) // line buffer + sliding window, S_wts == 1
+
+#ifndef CONV_ENGINE
+#define CONV_ENGINE ENGINE_DIRECT
+#endif
+
+/*
+ * Compute units.  cnn.cl builds NUM_CU copies of the cnn kernel (cnn,
+ * cnn_1, ... cnn_<NUM_CU-1>), each with its own datapath; the host
+ * gives every unit a contiguous slice of the images of a chunk and
+ * runs the units side by side on separate command queues.  Only the
+ * direct and line-buffer engines are replicated.
+ */
+#ifndef NUM_CU
+#define NUM_CU (1)
+#endif
+#if NUM_CU < 1 || NUM_CU > 4
+#error "NUM_CU must be between 1 and 4"
+#endif
+
+#ifndef LB_MAX_K
+#define LB_MAX_K (FIX_K ? K_WTS : 5)
+#endif
+#ifndef LB_MAX_C
+#define LB_MAX_C (FIX_C && FIX_K && FIX_S ? DEV_C_OFM * S_WTS + K_WTS - S_WTS : 256)
+#endif
+#ifndef LB_MAX_TM
+#define LB_MAX_TM (FIX_TM ? TM : 16)
+#endif
+#ifndef LB_MAX_TN
+#define LB_MAX_TN (FIX_TN ? TN : 16)
+#endif
+
+/*
+ * im2col + GEMM kernel (cnn_gemm), built next to cnn unless GEMM_BS is
+ * 0.  It multiplies the M x (N*K*K) weights by the host-built
+ * (N*K*K) x (R_ofm*C_ofm) im2col matrix of each image on a
+ * GEMM_BS x GEMM_BS array of MACs, by default as many as the TM x TN
+ * array of cnn.  The host picks it per layer (ENGINE_GEMM), see -engine
+ * in main.cpp.
+ */
+#define ENGINE_GEMM    (2)
+
+#ifndef GEMM_BS
+#define GEMM_BS (4)
+#endif
+
+/*
+ * Pointwise / fully-connected kernel (cnn_pointwise), built unless
+ * PW_BQ is 0.  For K_wts == 1 or R_ofm == C_ofm == 1 the layer is a
+ * plain M x (N*K*K) times (N*K*K) x (batch*R*C) product; the columns
+ * run across images, so each block of PW_BM weight rows is fetched
+ * once per PW_BQ output pixels of the whole batch rather than once per
+ * image.  The host routes such layers to it (ENGINE_POINTWISE).
+ */
+#define ENGINE_POINTWISE (3)
+
+#ifndef PW_BM
+#define PW_BM (4)
+#endif
+#ifndef PW_BQ
+#define PW_BQ (16)
+#endif
+
+/*
+ * Block-sparse kernel (cnn_sparse), built unless SP_BN is 0.  Pruned
+ * layers upload their weights compressed by wts_to_blocks() in
+ * layout643.h: per output channel only the SP_BN-channel blocks that
+ * hold a nonzero, so zero blocks are neither fetched nor multiplied.
+ * Picked with -engine=sparse (ENGINE_SPARSE).
+ */
+#define ENGINE_SPARSE (4)
+
+#ifndef SP_BN
+#define SP_BN (8)
+#endif
+
+// Elements of compressed M x N x K x K weights with every block kept
+#define SIZEw_SPARSE(M,N,K) ((M) + 1 + (M) * CEIL_DIV(N, SP_BN) * (1 + SP_BN * (K) * (K)))
+
+/*
+ * Zero run-length activation transport (cnn_unzrle / cnn_zrle), built
+ * unless ZRLE is 0.  With -zrle the host ships activations packed as
+ * in zrle643.h, one mask bit per element plus the nonzero values, and
+ * these kernels unpack them into input_buf and pack output_buf for the
+ * trip back.
+ */
+#ifndef ZRLE
+#define ZRLE (1)
+#endif
+#define ZRLE_BLOCK (32) // elements per mask word
+
+/*
+ * Persistent kernel (cnn_persistent), built unless JOBQ is 0.  With
+ * -persistent the host launches it once and posts every chunk as a
+ * cnn_job to a ring of JOBQ descriptors in global memory instead of
+ * launching cnn.  The kernel reads buffers the host rewrites while it
+ * runs, so build it with aoc -opt-arg -nocaching.
+ */
+#ifndef JOBQ
+#define JOBQ (16)
+#endif
+#define JOB_WORDS (sizeof(cnn_job) / sizeof(uint64_t))
+
+/*
+ * Job-table kernel (cnn_jobs), built unless JOB_TABLE is 0.  One launch
+ * runs a table of cnn_job descriptors back to back, each with its own
+ * layer and buffer offsets, see -jobs in main.cpp.
+ */
+#ifndef JOB_TABLE
+#define JOB_TABLE (1)
+#endif
+
+/*
+ * Device tensor layouts.  Select with -DACT_LAYOUT=... and
+ * -DWTS_LAYOUT=... on both the aoc and the host compile lines (or edit
+ * the defaults below).  The blocked layouts use the compile-time TN/TM
+ * as block sizes and pad channels up to a whole block; they index
+ * correctly for any runtime Tm/Tn but stream best when these match.
+ */
+#define LAYOUT_NCHW     (0) // [B][N][R][C], same as the host reference
+#define LAYOUT_NHWC     (1) // [B][R][C][N]
+#define LAYOUT_NCHWc    (2) // [B][N/TN][R][C][TN] (outputs blocked by TM)
+
+#define WLAYOUT_MNKK    (0) // [M][N][K][K], same as the host reference
+#define WLAYOUT_BLOCKED (1) // [M/TM][N/TN][K][K][TM][TN]
+#define WLAYOUT_PACKED  (2) // [M/TM][N/TN][TM][TN][K][K], cnn.cl tile order
+
+#ifndef ACT_LAYOUT
+#define ACT_LAYOUT LAYOUT_NCHW
+#endif
+#ifndef WTS_LAYOUT
+#define WTS_LAYOUT WLAYOUT_MNKK
+#endif
+
+#define CEIL_DIV(a,b) (((a)+(b)-1)/(b))
+#define ROUND_UP(a,b) (CEIL_DIV(a,b)*(b))
+
+/*
+ * Exact tiles.  With -DEXACT_TILES=1 (on both compile lines) the host
+ * pads R_ofm, C_ofm, M_ofm and N_ifm up to multiples of Tr, Tc, Tm and
+ * Tn with zeros and crops the result on readback, so cnn.cl runs every
+ * tile loop with a constant trip count instead of a MIN() bound.  The
+ * DEV_* sizes are the padded problem seen by a kernel with FIX_* set.
+ */
+#ifndef EXACT_TILES
+#define EXACT_TILES (0)
+#endif
+
+#if EXACT_TILES
+#if (FIX_R && !FIX_TR) || (FIX_C && !FIX_TC) || (FIX_M && !FIX_TM) || (FIX_N && !FIX_TN)
+#error "EXACT_TILES needs the tile size fixed wherever the dimension is fixed"
+#endif
+#define TILE_END(base,T,D) ((base)+(T))
+#define DEV_R_OFM ROUND_UP(R_OFM,TR)
+#define DEV_C_OFM ROUND_UP(C_OFM,TC)
+#define DEV_M_OFM ROUND_UP(M_OFM,TM)
+#define DEV_N_IFM ROUND_UP(N_IFM,TN)
+#else
+#define TILE_END(base,T,D) MIN((base)+(T),(D))
+#define DEV_R_OFM R_OFM
+#define DEV_C_OFM C_OFM
+#define DEV_M_OFM M_OFM
+#define DEV_N_IFM N_IFM
+#endif
 
 /*
  * Access macros
+ *
+ * ACT_LAYOUT_IS_REF / WTS_LAYOUT_IS_REF say whether ARRAYi/ARRAYo and
+ * ARRAYw index exactly like the host's ARRAY4 reference layout.  When
+ * they do, the host keeps a single copy of each tensor and validates
+ * against it directly.  SIZEi/SIZEo/SIZEw give the number of elements
+ * to allocate for each device tensor.
  */
+#define ACT_LAYOUT_IS_REF (ACT_LAYOUT == LAYOUT_NCHW)
+#define WTS_LAYOUT_IS_REF (WTS_LAYOUT == WLAYOUT_MNKK)
+
+#if ACT_LAYOUT == LAYOUT_NCHW
 #define ARRAYi(ptr,iB,iN,iR,iC,dB,dN,dR,dC) ((ptr)[(iB)*(dN)*(dR)*(dC)+(iN)*(dR)*(dC)+(iR)*(dC)+(iC)])
 #define ARRAYo(ptr,iB,iM,iR,iC,dB,dM,dR,dC) ((ptr)[(iB)*(dM)*(dR)*(dC)+(iM)*(dR)*(dC)+(iR)*(dC)+(iC)])
+#define SIZEi(dB,dN,dR,dC) ((dB)*(dN)*(dR)*(dC))
+#define SIZEo(dB,dM,dR,dC) ((dB)*(dM)*(dR)*(dC))
+#elif ACT_LAYOUT == LAYOUT_NHWC
+#define ARRAYi(ptr,iB,iN,iR,iC,dB,dN,dR,dC) ((ptr)[(iB)*(dR)*(dC)*(dN)+(iR)*(dC)*(dN)+(iC)*(dN)+(iN)])
+#define ARRAYo(ptr,iB,iM,iR,iC,dB,dM,dR,dC) ((ptr)[(iB)*(dR)*(dC)*(dM)+(iR)*(dC)*(dM)+(iC)*(dM)+(iM)])
+#define SIZEi(dB,dN,dR,dC) ((dB)*(dN)*(dR)*(dC))
+#define SIZEo(dB,dM,dR,dC) ((dB)*(dM)*(dR)*(dC))
+#elif ACT_LAYOUT == LAYOUT_NCHWc
+#define ARRAYi(ptr,iB,iN,iR,iC,dB,dN,dR,dC) ((ptr)[(((iB)*CEIL_DIV(dN,TN)+(iN)/TN)*(dR)*(dC)+(iR)*(dC)+(iC))*TN+(iN)%TN])
+#define ARRAYo(ptr,iB,iM,iR,iC,dB,dM,dR,dC) ((ptr)[(((iB)*CEIL_DIV(dM,TM)+(iM)/TM)*(dR)*(dC)+(iR)*(dC)+(iC))*TM+(iM)%TM])
+#define SIZEi(dB,dN,dR,dC) ((dB)*CEIL_DIV(dN,TN)*TN*(dR)*(dC))
+#define SIZEo(dB,dM,dR,dC) ((dB)*CEIL_DIV(dM,TM)*TM*(dR)*(dC))
+#endif
+
+#if WTS_LAYOUT == WLAYOUT_MNKK
 #define ARRAYw(ptr,iM,iN,iR,iC,dM,dN,dR,dC) ((ptr)[(iM)*(dN)*(dR)*(dC)+(iN)*(dR)*(dC)+(iR)*(dC)+(iC)])
+#define SIZEw(dM,dN,dR,dC) ((dM)*(dN)*(dR)*(dC))
+#elif WTS_LAYOUT == WLAYOUT_BLOCKED
+#define ARRAYw(ptr,iM,iN,iR,iC,dM,dN,dR,dC) ((ptr)[((((iM)/TM)*CEIL_DIV(dN,TN)+(iN)/TN)*(dR)*(dC)+(iR)*(dC)+(iC))*TM*TN+((iM)%TM)*TN+(iN)%TN])
+#define SIZEw(dM,dN,dR,dC) (CEIL_DIV(dM,TM)*TM*CEIL_DIV(dN,TN)*TN*(dR)*(dC))
+#elif WTS_LAYOUT == WLAYOUT_PACKED
+// Each (to, ti) tile is one contiguous burst, stored in the order the
+// too/tii/i/j loops of cnn.cl consume it, and tiles follow the to/ti
+// tile loops as LOOP_ORDER nests them.  Use with runtime Tm/Tn equal to
+// TM/TN.
+#if WPACK_TI_OUTER
+#define WPACK_TILE(iM,iN,dM,dN) (((iN)/TN)*CEIL_DIV(dM,TM)+(iM)/TM)
+#else
+#define WPACK_TILE(iM,iN,dM,dN) (((iM)/TM)*CEIL_DIV(dN,TN)+(iN)/TN)
+#endif
+#define ARRAYw(ptr,iM,iN,iR,iC,dM,dN,dR,dC) ((ptr)[((WPACK_TILE(iM,iN,dM,dN)*TM+(iM)%TM)*TN+(iN)%TN)*(dR)*(dC)+(iR)*(dC)+(iC)])
+#define SIZEw(dM,dN,dR,dC) (CEIL_DIV(dM,TM)*TM*CEIL_DIV(dN,TN)*TN*(dR)*(dC))
+#endif
 
 #endif
@@ -0,0 +1,118 @@
+#ifndef LAYOUT643_H
+#define LAYOUT643_H
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Host-side conversion between the reference layout (ARRAY4) and the
+ * device layouts selected in kernel643.h.  Activation transposes use
+ * 4x4 SSE tiles and all conversions are split across host threads.
+ *
+ */
+#include "util643.h"
+#include "instance643.h"
+#include "kernel643.h"
+
+/* Default 4D array layout used by validation input and output.
+ * See kernel643.h for kernel specific layout of input, output 
+ * and weights. */
+#define ARRAY4(ptr,i4,i3,i2,i1,d4,d3,d2,d1) ((ptr)[(i4)*(d3)*(d2)*(d1)+(i3)*(d2)*(d1)+(i2)*(d1)+(i1)])
+
+// Number of host threads used by the conversions (0 = one per core)
+extern unsigned host_threads;
+
+// Run fn(begin, end, ctx) over [0, n) split across the host threads
+void parallel_for(uint64_t n, void (*fn)(uint64_t begin, uint64_t end, void *ctx), void *ctx);
+
+// dst[c][r] = src[r][c] for a rows x cols block with the given leading dimensions
+void transpose2d(const cnndata_t *src, uint64_t src_ld, cnndata_t *dst, uint64_t dst_ld,
+                 uint64_t rows, uint64_t cols);
+
+// Convert num_images activation images of depth D and size R x C between
+// ARRAY4 and ACT_LAYOUT.  The device images are dev_D x dev_R x dev_C,
+// at least D x R x C, with the padding zero-filled (see EXACT_TILES).
+// block is the channel block of the NCHWc layout (TN for inputs, TM for
+// outputs).  Pointers address the first image.
+void act_to_device(const cnndata_t *ref, cnndata_t *dev, uint64_t num_images,
+                   uint64_t D, uint64_t R, uint64_t C, uint64_t dev_D, uint64_t dev_R,
+                   uint64_t dev_C, uint64_t block);
+void act_from_device(const cnndata_t *dev, cnndata_t *ref, uint64_t num_images,
+                     uint64_t D, uint64_t R, uint64_t C, uint64_t dev_D, uint64_t dev_R,
+                     uint64_t dev_C, uint64_t block);
+
+// Stride phase decomposition.  A stride-S convolution equals a unit-
+// stride one over the S*S phase sub-images P(p,q)[n][a][b] =
+// in[n][S*a+p][S*b+q], stacked as channels n*S*S + p*S + q, with weights
+// w'[m][n*S*S + p*S + q][i][j] = w[m][n][S*i+p][S*j+q] of size
+// ceil(K/S) (zero where S*i+p >= K).  Every input pixel lands in exactly
+// one phase, at the position given by the PHASE_* macros.  All tensors
+// here are ARRAY4; phase images are N*S*S x phase_R x phase_C.
+#define PHASE_D(n,r,c,S) ((n)*(S)*(S) + ((r)%(S))*(S) + (c)%(S))
+#define PHASE_RC(x,S)    ((x)/(S))
+
+void act_to_phases(const cnndata_t *ref, cnndata_t *phased, uint64_t num_images, uint64_t N,
+                   uint64_t R, uint64_t C, uint64_t S, uint64_t phase_R, uint64_t phase_C);
+void act_from_phases(const cnndata_t *phased, cnndata_t *ref, uint64_t num_images, uint64_t N,
+                     uint64_t R, uint64_t C, uint64_t S, uint64_t phase_R, uint64_t phase_C);
+void wts_to_phases(const cnndata_t *ref, cnndata_t *phased, uint64_t M, uint64_t N, uint64_t K,
+                   uint64_t S);
+
+// im2col matrices of num_images ARRAY4 images for cnn_gemm: per image
+// (N*K*K) x (R_ofm*C_ofm), row (ti, i, j), column (row, col), holding
+// input[ti][S*row+i-pad_top][S*col+j-pad_left], zero outside the
+// R x C input image.
+void im2col(const cnndata_t *ref, cnndata_t *cols, uint64_t num_images, uint64_t N, uint64_t R,
+            uint64_t C, uint64_t K, uint64_t S, uint64_t R_ofm, uint64_t C_ofm, uint64_t pad_top,
+            uint64_t pad_left);
+
+// Convert M x N x K x K weights from ARRAY4 to WTS_LAYOUT, zero-padded
+// to dev_M x dev_N
+void wts_to_device(const cnndata_t *ref, cnndata_t *dev, uint64_t M, uint64_t N, uint64_t K,
+                   uint64_t dev_M, uint64_t dev_N);
+
+// Compress M x N x K x K ARRAY4 weights for cnn_sparse: each output
+// channel keeps the SP_BN-channel blocks that hold a nonzero weight.
+// dev holds the M + 1 block offsets of the output channels and the
+// channel block of every kept block as 32-bit unsigned ints, then the
+// kept blocks, SP_BN x K x K each, zero past channel N.  Returns the
+// elements used, at most SIZEw_SPARSE(M, N, K), and the kept blocks in
+// *kept.
+uint64_t wts_to_blocks(const cnndata_t *ref, cnndata_t *dev, uint64_t M, uint64_t N, uint64_t K,
+                       uint64_t *kept);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef NATIVE643_H
+#define NATIVE643_H
+
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Native backend (-native).  device/cnn.cl is compiled by g++ into the
+ * host through clshim643.h, so the same kernel source runs at native
+ * speed on the host tensors without an OpenCL device or the emulator.
+ *
+ */
+#include <stddef.h>
+#include "util643.h"
+#include "instance643.h"
+#include "kernel643.h"
+
+// Compile the kernels into the host (0 = none)
+#ifndef NATIVE_KERNELS
+#define NATIVE_KERNELS (1)
+#endif
+
+// Runs one launch of the engine's kernel (ENGINE_* in kernel643.h) on
+// batch images, with the arguments the device kernel would get.  input
+// and output address the first image, input_image and output_image are
+// the elements per image.  The images are split across the host
+// threads, each thread running the kernel on its own images.
+void native_launch(int engine, const cnndata_t *input, const cnndata_t *weights, cnndata_t *output,
+                   uint64_t batch, uint64_t input_image, uint64_t output_image,
+                   const kernel_size *kernel, const layer_size *layer);
+
+// A kernel argument as clSetKernelArg takes it: the data of a buffer
+// argument (mem), otherwise the size bytes of value
+typedef struct native_arg {
+    void *mem;
+    const void *value;
+    size_t size;
+} native_arg;
+
+typedef void (*native_entry)(const native_arg *args);
+
+// Entry point of the kernel of cnn.cl called name, taking its arguments
+// in order, or NULL if the build has no such kernel.  The calling
+// thread runs the whole kernel (see host/sim/simcl643.cpp).
+native_entry native_kernel(const char *name);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef TENSORIO643_H
+#define TENSORIO643_H
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Memory-mapped tensor files.  A tensor file is either a NumPy .npy
+ * file holding little-endian float32 ('<f4', C order) or a raw file of
+ * little-endian float32 values with no header.  Files are always in the
+ * reference layout (ARRAY4): inputs and outputs are [B][N][R][C],
+ * weights are [M][N][K][K].
+ *
+ */
+#include <stddef.h>
+#include "util643.h"
+#include "instance643.h"
+
+typedef struct mapped_tensor {
+    void*      map_base;   // start of the mapping (NULL if unmapped)
+    size_t     map_bytes;  // length of the mapping
+    cnndata_t* data;       // first element, past any .npy header
+    uint64_t   num_elem;
+} mapped_tensor;
+
+// Map an existing tensor file read-only.  The file must hold exactly
+// num_elem values.  Returns false (and prints why) on any mismatch.
+bool map_tensor_file(const char *path, uint64_t num_elem, mapped_tensor *t);
+
+// Create (or truncate) a tensor file of the given shape and map it
+// read-write.  A .npy header is written when path ends in ".npy".  The
+// data starts zero-filled and is 64-byte aligned.
+bool create_tensor_file(const char *path, const uint64_t *shape, int ndim, mapped_tensor *t);
+
+// Packed-weight cache.  Weights that have been converted to a packed
+// device layout are cached as <dir>/wpack_<hash>_<shape>_<tiling>.bin
+// (a 64-byte header followed by the packed tensor), so later runs can
+// map them instead of repacking.  The name covers the weight hash,
+// M/N/K, WTS_LAYOUT and the TM/TN block sizes.
+uint64_t hash_tensor(const cnndata_t *data, uint64_t num_elem);
+void packed_weights_path(char *path, size_t len, const char *dir, uint64_t hash,
+                         uint64_t M, uint64_t N, uint64_t K);
+bool map_packed_weights(const char *path, uint64_t num_elem, mapped_tensor *t);
+bool store_packed_weights(const char *path, const cnndata_t *data, uint64_t num_elem);
+
+// Unmap.  Writes to a created file reach it through the shared mapping.
+// Safe to call on a tensor that was never mapped.
+void unmap_tensor(mapped_tensor *t);
+
+#endif
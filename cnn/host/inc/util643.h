@@ -44,6 +44,7 @@
 typedef unsigned long uint64_t;
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
 
 #define RANGE (100)
 
@@ -61,13 +62,48 @@ typedef struct layer_size {
     uint64_t R_ifm;
     uint64_t C_ifm;
     uint64_t N_ifm;
+
+    // Output channel to reads input channels (to / (M_ofm / groups)) *
+    // (N_ifm / groups) onward, N_ifm / groups of them; weights are
+    // M_ofm x (N_ifm / groups) x K_wts x K_wts.  groups == N_ifm is depthwise.
+    uint64_t groups;
+
+    // Zero halo above and left of the input, the same below and right:
+    // output row reads input rows S_wts * row - pad_top onward, and taps
+    // outside the R_ifm x C_ifm image are zero.  R_ifm = R_ofm * S_wts +
+    // K_wts - S_wts - 2 * pad_top, likewise C_ifm with pad_left.
+    uint64_t pad_top;
+    uint64_t pad_left;
+
+    // Output channels [m_first, m_end) of one kernel instance.  Its
+    // weights and outputs stay where they are in the whole M_ofm
+    // tensors (see -partition in main.cpp).
+    uint64_t m_first;
+    uint64_t m_end;
+
+    // First image of one kernel instance in the input and output
+    // buffers, it runs batch_size images from there
+    uint64_t b_first;
 } layer_size;
 
+// One job of cnn_jobs or the persistent kernel (cnn_persistent):
+// batch_size images input_offset and output_offset elements into the
+// input and output buffers, run as layer with the weights weight_offset
+// elements into the weight buffer.  batch_size 0 stops cnn_persistent.
+typedef struct cnn_job {
+    uint64_t input_offset;
+    uint64_t output_offset;
+    uint64_t weight_offset;
+    uint64_t batch_size;
+    layer_size layer;
+} cnn_job;
+
 typedef struct kernel_size {
     uint64_t Tm;
     uint64_t Tr;
     uint64_t Tc;
     uint64_t Tn;
+    uint64_t Tb; // images sharing each weight tile
 } kernel_size;
 
 #endif
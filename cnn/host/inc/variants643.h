@@ -0,0 +1,98 @@
+#ifndef VARIANTS643_H
+#define VARIANTS643_H
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Registry of precompiled kernel binaries.  The manifest (by default
+ * cnn_variants.txt next to the host) lists one binary per line as
+ *
+ *     <prefix> KEY=value ...
+ *
+ * where the keys are the parameters the binary was compiled with:
+ * fixed sizes K, S, R, C, M, N, TR, TC, TM, TN, TB (a key that is
+ * absent is read at run time), the layouts ACT and WTS, EXACT, the
+ * ENGINE and the loop ORDER (defaults 0, 0, 0, 0 and row,col,to,ti).
+ * Line-buffer binaries (ENGINE=1) are only selected for S=1.  '#'
+ * starts a comment.  The binary itself is found with
+ * getBoardBinaryFile(prefix).
+ * build_variant.sh builds a binary and writes its line.
+ *
+ * Layouts and EXACT are compile-time in the host as well, so only
+ * binaries that agree with this host build are ever selected; blocked
+ * layouts must also be built with the host's TM/TN.
+ *
+ */
+#include <string>
+#include <vector>
+#include "util643.h"
+
+#define NUM_TILE_LOOPS 4
+enum { LOOP_ROW, LOOP_COL, LOOP_TO, LOOP_TI };
+extern const char *loop_name[NUM_TILE_LOOPS];
+
+typedef struct kernel_variant {
+    std::string prefix;
+    layer_size  layer;   // fixed layer sizes, 0 where read at run time
+    kernel_size tiles;   // fixed tile sizes, 0 where read at run time
+    int act_layout;
+    int wts_layout;
+    int exact_tiles;
+    int engine;          // CONV_ENGINE
+    int loop_order[NUM_TILE_LOOPS]; // outermost first
+    int num_fixed;       // number of fixed sizes, higher is more specialized
+} kernel_variant;
+
+// Parse "a,b,c,d" into loop_order (outermost first).  False unless it
+// is a permutation of row,col,to,ti.
+bool parse_loop_order(const char *text, int *loop_order);
+
+// Whether the ti tile loop nests outside the to loop
+bool loop_ti_outer(const int *loop_order);
+
+// Read the manifest.  A missing file gives an empty list; malformed
+// lines are reported and skipped.
+void load_variant_manifest(const char *path, std::vector<kernel_variant> &variants);
+
+// Index of the most specialized variant that can run the layer, or -1.
+// tiles holds tile sizes given on the command line (0 = any) and
+// loop_order, if not NULL, the requested loop order.
+int select_variant(const std::vector<kernel_variant> &variants, const layer_size *layer,
+                   const kernel_size *tiles, const int *loop_order);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef ZRLE643_H
+#define ZRLE643_H
+
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Zero run-length activation transport (-zrle).  A packed stream of n
+ * elements holds, in cnndata_t-sized words:
+ *
+ *   [0]                 number of nonzero elements, unsigned
+ *   [1, 1 + nb)         one unsigned mask per block of ZRLE_BLOCK
+ *                       elements, bit k set when element k is nonzero
+ *   [1 + nb, ...)       the nonzero elements in order
+ *
+ * with nb = CEIL_DIV(n, ZRLE_BLOCK).  The host codecs below use SSE
+ * compares and are split across the host threads; cnn_unzrle and
+ * cnn_zrle in cnn.cl are the device side.
+ *
+ */
+#include "util643.h"
+#include "instance643.h"
+#include "kernel643.h"
+
+// Words of a packed stream of n elements with every element nonzero
+#define ZRLE_MAX(n) (1 + CEIL_DIV(n, ZRLE_BLOCK) + (n))
+
+// Words in the header (count and masks) of a packed stream of n elements
+#define ZRLE_HEADER(n) (1 + CEIL_DIV(n, ZRLE_BLOCK))
+
+// Pack n elements of src, returns the words used.  Zeros of either sign
+// are dropped and unpack as +0.
+uint64_t zrle_encode(const cnndata_t *src, uint64_t n, cnndata_t *packed);
+
+// Unpack a stream of n elements into dst
+void zrle_decode(const cnndata_t *packed, uint64_t n, cnndata_t *dst);
+
+#endif
@@ -0,0 +1,894 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Simulated OpenCL device (make sim).  The OpenCL calls of the host run
+ * the kernels of device/cnn.cl natively (native_kernel in native643.h)
+ * and stamp every command with modeled device times, so streaming,
+ * overlap and scheduling can be timed on any machine.
+ *
+ * Each command queue is an in-order worker thread.  A command waits for
+ * the events of its wait list, then it is timed on a virtual clock:
+ *   - a transfer starts SIMCL_LAUNCH_US after its queue, its wait list
+ *     and its PCIe direction are done and moves its bytes at
+ *     SIMCL_PCIE_GBPS;
+ *   - a kernel starts SIMCL_LAUNCH_US after its queue, its wait list
+ *     and its hardware (one per cl_kernel, so cnn_1..3 overlap) are
+ *     done and runs its
+ *     modeled cycles at SIMCL_FMAX_MHZ.  Every Tm x Tn tile of cnn
+ *     takes Tr * Tc * K * K cycles plus SIMCL_TILE_CYCLES to fill and
+ *     drain; cnn_gemm and cnn_pointwise count their blocks the same
+ *     way, cnn_sparse is costed as dense and cnn_persistent takes its
+ *     wall-clock time.
+ * The host clock advances by the wall-clock time between OpenCL calls
+ * and jumps to the end of each command the host waits for, so host work
+ * is counted and the functional execution of the commands is not.
+ *
+ * Settings, from the environment:
+ *   SIMCL_PCIE_GBPS     PCIe bandwidth per direction, GB/s (6.5)
+ *   SIMCL_LAUNCH_US     latency of every command, us (20)
+ *   SIMCL_FMAX_MHZ      kernel clock, MHz (240)
+ *   SIMCL_TILE_CYCLES   fill and drain of every tile, cycles (100)
+ *   SIMCL_MAX_ALLOC_MB  largest buffer, MB (2048)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <set>
+#include "CL/opencl.h"
+#include "native643.h"
+
+#define SIM_MAX_ARGS  (8)
+#define SIM_MAX_VALUE (256)  // bytes of one kernel argument
+#define SIM_ALIGN     (1024) // CL_DEVICE_MEM_BASE_ADDR_ALIGN in bytes
+
+struct _cl_platform_id { int unused; };
+struct _cl_device_id { int unused; };
+struct _cl_context { int unused; };
+struct _cl_program { int unused; };
+
+struct _cl_mem {
+    char *data;
+    size_t size;
+    cl_mem parent; // NULL unless a sub-buffer
+};
+
+struct _cl_kernel {
+    char name[64];
+    native_entry entry;
+    native_arg args[SIM_MAX_ARGS];
+    char values[SIM_MAX_ARGS][SIM_MAX_VALUE];
+    cl_ulong free_ns; // its hardware is busy until then
+};
+
+struct _cl_event {
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    bool done;
+    int refs; // the host's and the queue's
+    cl_ulong queued, start, end;
+};
+
+typedef enum { CMD_WRITE, CMD_READ, CMD_KERNEL } cmd_type;
+
+typedef struct sim_cmd {
+    cmd_type type;
+    // transfers
+    void *dst;
+    const void *src;
+    size_t size;
+    // kernels, the arguments as of the enqueue
+    cl_kernel kernel;
+    native_arg args[SIM_MAX_ARGS];
+    char values[SIM_MAX_ARGS][SIM_MAX_VALUE];
+
+    // wait list, one reference held on each
+    cl_event *deps;
+    cl_uint num_deps;
+
+    cl_event event;
+    struct sim_cmd *next;
+} sim_cmd;
+
+struct _cl_command_queue {
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    sim_cmd *head, *tail;
+    int pending; // commands queued or running
+    bool stop;
+    cl_ulong ready_ns; // end of its last command
+};
+
+static _cl_platform_id sim_platform;
+static _cl_device_id sim_device;
+static std::set<cl_mem> sim_mems; // live buffers, to tell buffer arguments
+
+// Model settings
+static bool sim_ready = false;
+static double pcie_gbps, launch_ns, fmax_mhz, tile_cycles;
+static cl_ulong max_alloc;
+
+// Virtual clock, under sim_lock
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static cl_ulong host_ns;       // host time
+static cl_ulong host_left = 0; // wall-clock time the host left the last call, 0 inside a call
+static cl_ulong pcie_free[2];  // the write and the read direction are busy until then
+
+static cl_ulong wall_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (cl_ulong)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static double sim_setting(const char *name, double value) {
+    const char *s = getenv(name);
+    return s ? atof(s) : value;
+}
+
+static void sim_init() {
+    if (sim_ready) {
+        return;
+    }
+    pcie_gbps = sim_setting("SIMCL_PCIE_GBPS", 6.5);
+    launch_ns = sim_setting("SIMCL_LAUNCH_US", 20) * 1000;
+    fmax_mhz = sim_setting("SIMCL_FMAX_MHZ", 240);
+    tile_cycles = sim_setting("SIMCL_TILE_CYCLES", 100);
+    max_alloc = (cl_ulong)sim_setting("SIMCL_MAX_ALLOC_MB", 2048) << 20;
+    if (pcie_gbps <= 0 || fmax_mhz <= 0 || launch_ns < 0 || tile_cycles < 0) {
+        printf("ERROR: SIMCL_PCIE_GBPS and SIMCL_FMAX_MHZ must be positive, SIMCL_LAUNCH_US and SIMCL_TILE_CYCLES not negative\n");
+        exit(1);
+    }
+    host_ns = wall_ns();
+    sim_ready = true;
+}
+
+// Host time passes between the calls below, not inside them
+static void host_enter() {
+    pthread_mutex_lock(&sim_lock);
+    if (host_left) {
+        host_ns += wall_ns() - host_left;
+        host_left = 0;
+    }
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static void host_leave() {
+    pthread_mutex_lock(&sim_lock);
+    host_left = wall_ns();
+    pthread_mutex_unlock(&sim_lock);
+}
+
+// The host waited for a command ending at t
+static void host_wait(cl_ulong t) {
+    pthread_mutex_lock(&sim_lock);
+    host_ns = MAX(host_ns, t);
+    pthread_mutex_unlock(&sim_lock);
+}
+
+static cl_int put_info(const void *value, size_t size, size_t param_value_size, void *param_value,
+                       size_t *param_value_size_ret) {
+    if (param_value_size_ret) {
+        *param_value_size_ret = size;
+    }
+    if (param_value) {
+        if (param_value_size < size) {
+            return CL_INVALID_VALUE;
+        }
+        memcpy(param_value, value, size);
+    }
+    return CL_SUCCESS;
+}
+
+#define PUT_STRING(s) put_info(s, strlen(s) + 1, param_value_size, param_value, param_value_size_ret)
+#define PUT_VALUE(type, v) do { type _v = (v); \
+    return put_info(&_v, sizeof(_v), param_value_size, param_value, param_value_size_ret); } while (0)
+
+//----------------------------------------------
+// Kernel model
+//----------------------------------------------
+
+#define ARG(i, type) (*(const type*)args[i].value)
+
+// Cycles of the direct kernel: per tile the Tm x Tn array runs the
+// Tr x Tc outputs of every tap, clipped at the edges of the layer
+static double direct_cycles(uint64_t batch, const kernel_size *kp, const layer_size *l) {
+    uint64_t Tr = FIX_TR ? TR : kp->Tr;
+    uint64_t Tc = FIX_TC ? TC : kp->Tc;
+    uint64_t Tm = FIX_TM ? TM : kp->Tm;
+    uint64_t Tn = FIX_TN ? TN : kp->Tn;
+    uint64_t Ng = l->N_ifm / l->groups;
+    double depth_tiles = (double)batch * CEIL_DIV(l->m_end - l->m_first, Tm) * CEIL_DIV(Ng, Tn);
+
+    return depth_tiles * (l->R_ofm * l->C_ofm * l->K_wts * l->K_wts +
+                          CEIL_DIV(l->R_ofm, Tr) * CEIL_DIV(l->C_ofm, Tc) * tile_cycles);
+}
+
+// Modeled cycles of one launch of the kernel called name, < 0 if it
+// has no model
+static double kernel_cycles(const char *name, const native_arg *args) {
+    if (strcmp(name, "cnn_zrle") == 0 || strcmp(name, "cnn_unzrle") == 0) {
+        return ARG(2, uint64_t); // one word per cycle
+    }
+    if (strcmp(name, "cnn_persistent") == 0) {
+        return -1;
+    }
+    if (strcmp(name, "cnn_jobs") == 0) {
+        const cnn_job *jobs = (const cnn_job*)args[5].mem;
+        double cycles = 0;
+        uint64_t j;
+
+        for (j = 0; j < ARG(3, uint64_t); j++) {
+            cycles += direct_cycles(jobs[j].batch_size, &ARG(4, kernel_size), &jobs[j].layer);
+        }
+        return cycles;
+    }
+
+    uint64_t batch = ARG(3, uint64_t);
+    const kernel_size *kp = &ARG(4, kernel_size);
+    const layer_size *l = &ARG(5, layer_size);
+    uint64_t taps = l->N_ifm / l->groups * l->K_wts * l->K_wts;
+    uint64_t Mr = l->m_end - l->m_first;
+
+#if GEMM_BS > 0
+    if (strcmp(name, "cnn_gemm") == 0) {
+        return (double)batch * CEIL_DIV(Mr, GEMM_BS) * CEIL_DIV(l->R_ofm * l->C_ofm, GEMM_BS) *
+               (taps + tile_cycles);
+    }
+#endif
+#if PW_BQ > 0
+    if (strcmp(name, "cnn_pointwise") == 0) {
+        return (double)CEIL_DIV(Mr, PW_BM) * CEIL_DIV(batch * l->R_ofm * l->C_ofm, PW_BQ) *
+               (taps + tile_cycles);
+    }
+#endif
+    // cnn, cnn_1..3 and cnn_sparse with every block kept
+    return direct_cycles(batch, kp, l);
+}
+
+//----------------------------------------------
+// Events and queues
+//----------------------------------------------
+
+static cl_event event_create(cl_ulong queued, int refs) {
+    cl_event e = (cl_event)calloc(1, sizeof(struct _cl_event));
+    if (e == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&e->lock, NULL);
+    pthread_cond_init(&e->done_cond, NULL);
+    e->refs = refs;
+    e->queued = queued;
+    return e;
+}
+
+static void event_wait(cl_event e) {
+    pthread_mutex_lock(&e->lock);
+    while (!e->done) {
+        pthread_cond_wait(&e->done_cond, &e->lock);
+    }
+    pthread_mutex_unlock(&e->lock);
+}
+
+static void event_release(cl_event e) {
+    pthread_mutex_lock(&e->lock);
+    bool last = --e->refs == 0;
+    pthread_mutex_unlock(&e->lock);
+    if (last) {
+        pthread_cond_destroy(&e->done_cond);
+        pthread_mutex_destroy(&e->lock);
+        free(e);
+    }
+}
+
+// Runs cmd and times it on the virtual clock
+static void run_command(cl_command_queue q, sim_cmd *cmd) {
+    cl_event e = cmd->event;
+    cl_ulong ready = e->queued, start, end;
+    cl_uint i;
+
+    for (i = 0; i < cmd->num_deps; i++) {
+        event_wait(cmd->deps[i]);
+        ready = MAX(ready, cmd->deps[i]->end);
+        event_release(cmd->deps[i]);
+    }
+    free(cmd->deps);
+
+    if (cmd->type == CMD_KERNEL) {
+        cl_kernel k = cmd->kernel;
+        cl_ulong t0 = wall_ns();
+        k->entry(cmd->args);
+        cl_ulong wall = wall_ns() - t0;
+        double cycles = kernel_cycles(k->name, cmd->args);
+
+        pthread_mutex_lock(&sim_lock);
+        start = MAX(MAX(ready, q->ready_ns), k->free_ns) + (cl_ulong)launch_ns;
+        end = start + (cycles < 0 ? wall : (cl_ulong)(cycles * 1000 / fmax_mhz));
+        k->free_ns = end;
+    } else {
+        int dir = cmd->type == CMD_READ;
+        memcpy(cmd->dst, cmd->src, cmd->size);
+
+        pthread_mutex_lock(&sim_lock);
+        start = MAX(MAX(ready, q->ready_ns), pcie_free[dir]) + (cl_ulong)launch_ns;
+        end = start + (cl_ulong)(cmd->size / pcie_gbps); // bytes / (GB/s) = ns
+        pcie_free[dir] = end;
+    }
+    q->ready_ns = end;
+    pthread_mutex_unlock(&sim_lock);
+
+    pthread_mutex_lock(&e->lock);
+    e->start = start;
+    e->end = end;
+    e->done = true;
+    pthread_cond_broadcast(&e->done_cond);
+    pthread_mutex_unlock(&e->lock);
+    event_release(e); // the queue's reference
+}
+
+static void *queue_worker(void *arg) {
+    cl_command_queue q = (cl_command_queue)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        while (q->head == NULL && !q->stop) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        sim_cmd *cmd = q->head;
+        if (cmd == NULL) {
+            pthread_mutex_unlock(&q->lock);
+            return NULL;
+        }
+        q->head = cmd->next;
+        if (q->head == NULL) {
+            q->tail = NULL;
+        }
+        pthread_mutex_unlock(&q->lock);
+
+        run_command(q, cmd);
+        free(cmd);
+
+        pthread_mutex_lock(&q->lock);
+        q->pending--;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+}
+
+static void queue_wait(cl_command_queue q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->pending) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Queues cmd on q after the num_deps events of deps, stamped with the
+// host time; waits for it if blocking and hands its event to the host
+// if event is not NULL
+static cl_int enqueue(cl_command_queue q, sim_cmd *cmd, cl_uint num_deps, const cl_event *deps,
+                      cl_bool blocking, cl_event *event) {
+    cl_uint i;
+
+    if ((num_deps > 0) != (deps != NULL)) {
+        free(cmd);
+        return CL_INVALID_EVENT_WAIT_LIST;
+    }
+    for (i = 0; i < num_deps; i++) {
+        if (deps[i] == NULL) {
+            free(cmd);
+            return CL_INVALID_EVENT_WAIT_LIST;
+        }
+    }
+    if (num_deps > 0) {
+        cmd->deps = (cl_event*)malloc(num_deps * sizeof(cl_event));
+        if (cmd->deps == NULL) {
+            free(cmd);
+            return CL_OUT_OF_HOST_MEMORY;
+        }
+        for (i = 0; i < num_deps; i++) {
+            pthread_mutex_lock(&deps[i]->lock);
+            deps[i]->refs++;
+            pthread_mutex_unlock(&deps[i]->lock);
+            cmd->deps[i] = deps[i];
+        }
+        cmd->num_deps = num_deps;
+    }
+
+    pthread_mutex_lock(&sim_lock);
+    cmd->event = event_create(host_ns, event ? 2 : 1);
+    pthread_mutex_unlock(&sim_lock);
+    if (cmd->event == NULL) {
+        for (i = 0; i < cmd->num_deps; i++) {
+            event_release(cmd->deps[i]);
+        }
+        free(cmd->deps);
+        free(cmd);
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    cl_event e = cmd->event;
+    if (blocking) {
+        // hold the event past the queue's release
+        pthread_mutex_lock(&e->lock);
+        e->refs++;
+        pthread_mutex_unlock(&e->lock);
+    }
+
+    cmd->next = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail) {
+        q->tail->next = cmd;
+    } else {
+        q->head = cmd;
+    }
+    q->tail = cmd;
+    q->pending++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+
+    if (event) {
+        *event = e;
+    }
+    if (blocking) {
+        event_wait(e);
+        host_wait(e->end);
+        event_release(e);
+    }
+    return CL_SUCCESS;
+}
+
+static cl_int enqueue_transfer(cl_command_queue q, cmd_type type, cl_mem buffer, cl_bool blocking,
+                               size_t offset, size_t size, void *dst, const void *src, cl_uint num_deps,
+                               const cl_event *deps, cl_event *event) {
+    if (q == NULL) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+    if (buffer == NULL || sim_mems.count(buffer) == 0) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+    if (offset + size > buffer->size || (type == CMD_WRITE ? src : dst) == NULL) {
+        return CL_INVALID_VALUE;
+    }
+    sim_cmd *cmd = (sim_cmd*)calloc(1, sizeof(sim_cmd));
+    if (cmd == NULL) {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    cmd->type = type;
+    cmd->dst = type == CMD_WRITE ? buffer->data + offset : dst;
+    cmd->src = type == CMD_WRITE ? src : buffer->data + offset;
+    cmd->size = size;
+
+    host_enter();
+    cl_int status = enqueue(q, cmd, num_deps, deps, blocking, event);
+    host_leave();
+    return status;
+}
+
+//----------------------------------------------
+// OpenCL API
+//----------------------------------------------
+
+cl_int clGetPlatformIDs(cl_uint num_entries, cl_platform_id *platforms, cl_uint *num_platforms) {
+    sim_init();
+    if (num_platforms) {
+        *num_platforms = 1;
+    }
+    if (platforms && num_entries) {
+        platforms[0] = &sim_platform;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int clGetPlatformInfo(cl_platform_id platform, cl_platform_info param_name, size_t param_value_size,
+                         void *param_value, size_t *param_value_size_ret) {
+    switch (param_name) {
+    case CL_PLATFORM_NAME:
+        return PUT_STRING("Intel(R) FPGA SDK for OpenCL(TM) (simulated device)");
+    case CL_PLATFORM_VENDOR:
+        return PUT_STRING("Intel(R) Corporation");
+    case CL_PLATFORM_VERSION:
+        return PUT_STRING("OpenCL 1.2 simcl643");
+    case CL_PLATFORM_PROFILE:
+        return PUT_STRING("EMBEDDED_PROFILE");
+    }
+    return CL_INVALID_VALUE;
+}
+
+cl_int clGetDeviceIDs(cl_platform_id platform, cl_device_type device_type, cl_uint num_entries,
+                      cl_device_id *devices, cl_uint *num_devices) {
+    if (num_devices) {
+        *num_devices = 1;
+    }
+    if (devices && num_entries) {
+        devices[0] = &sim_device;
+    }
+    return CL_SUCCESS;
+}
+
+cl_int clGetDeviceInfo(cl_device_id device, cl_device_info param_name, size_t param_value_size,
+                       void *param_value, size_t *param_value_size_ret) {
+    sim_init();
+    switch (param_name) {
+    case CL_DEVICE_NAME:
+        return PUT_STRING("pac_a10 : Simulated device");
+    case CL_DEVICE_VENDOR:
+        return PUT_STRING("simcl643");
+    case CL_DEVICE_MAX_COMPUTE_UNITS:
+        PUT_VALUE(cl_uint, 1);
+    case CL_DEVICE_MEM_BASE_ADDR_ALIGN:
+        PUT_VALUE(cl_uint, SIM_ALIGN * 8); // bits
+    case CL_DEVICE_GLOBAL_MEM_SIZE:
+        PUT_VALUE(cl_ulong, 8ull << 30);
+    case CL_DEVICE_MAX_MEM_ALLOC_SIZE:
+        PUT_VALUE(cl_ulong, max_alloc);
+    }
+    return CL_INVALID_VALUE;
+}
+
+cl_context clCreateContext(const cl_context_properties *properties, cl_uint num_devices,
+                           const cl_device_id *devices,
+                           void (CL_CALLBACK *pfn_notify)(const char *, const void *, size_t, void *),
+                           void *user_data, cl_int *errcode_ret) {
+    sim_init();
+    printf("Simulated device: PCIe %.1f GB/s, launch %.0f us, kernel clock %.0f MHz, %.0f cycles per tile\n",
+           pcie_gbps, launch_ns / 1000, fmax_mhz, tile_cycles);
+    if (errcode_ret) {
+        *errcode_ret = CL_SUCCESS;
+    }
+    return (cl_context)calloc(1, sizeof(struct _cl_context));
+}
+
+cl_int clReleaseContext(cl_context context) {
+    free(context);
+    return CL_SUCCESS;
+}
+
+cl_command_queue clCreateCommandQueue(cl_context context, cl_device_id device,
+                                      cl_command_queue_properties properties, cl_int *errcode_ret) {
+    cl_command_queue q = (cl_command_queue)calloc(1, sizeof(struct _cl_command_queue));
+    if (q == NULL) {
+        if (errcode_ret) {
+            *errcode_ret = CL_OUT_OF_HOST_MEMORY;
+        }
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    if (pthread_create(&q->worker, NULL, queue_worker, q)) {
+        free(q);
+        if (errcode_ret) {
+            *errcode_ret = CL_OUT_OF_RESOURCES;
+        }
+        return NULL;
+    }
+    if (errcode_ret) {
+        *errcode_ret = CL_SUCCESS;
+    }
+    return q;
+}
+
+cl_int clReleaseCommandQueue(cl_command_queue command_queue) {
+    cl_command_queue q = command_queue;
+
+    if (q == NULL) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+    pthread_mutex_lock(&q->lock);
+    q->stop = true;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->worker, NULL); // after the queued commands
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    free(q);
+    return CL_SUCCESS;
+}
+
+cl_int clFlush(cl_command_queue command_queue) {
+    // the worker starts every command as it is queued
+    return command_queue ? CL_SUCCESS : CL_INVALID_COMMAND_QUEUE;
+}
+
+cl_int clFinish(cl_command_queue command_queue) {
+    if (command_queue == NULL) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+    host_enter();
+    queue_wait(command_queue);
+    pthread_mutex_lock(&sim_lock);
+    cl_ulong ready = command_queue->ready_ns;
+    pthread_mutex_unlock(&sim_lock);
+    host_wait(ready);
+    host_leave();
+    return CL_SUCCESS;
+}
+
+cl_mem clCreateBuffer(cl_context context, cl_mem_flags flags, size_t size, void *host_ptr,
+                      cl_int *errcode_ret) {
+    cl_int status = CL_SUCCESS;
+    cl_mem m = NULL;
+
+    if (size == 0 || size > max_alloc) {
+        status = CL_INVALID_BUFFER_SIZE;
+    } else if ((m = (cl_mem)calloc(1, sizeof(struct _cl_mem))) == NULL ||
+               (m->data = (char*)calloc(1, size)) == NULL) {
+        free(m);
+        m = NULL;
+        status = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    } else {
+        m->size = size;
+        if (flags & CL_MEM_COPY_HOST_PTR) {
+            memcpy(m->data, host_ptr, size);
+        }
+        sim_mems.insert(m);
+    }
+    if (errcode_ret) {
+        *errcode_ret = status;
+    }
+    return m;
+}
+
+cl_mem clCreateSubBuffer(cl_mem buffer, cl_mem_flags flags, cl_buffer_create_type buffer_create_type,
+                         const void *buffer_create_info, cl_int *errcode_ret) {
+    const cl_buffer_region *region = (const cl_buffer_region*)buffer_create_info;
+    cl_int status = CL_SUCCESS;
+    cl_mem m = NULL;
+
+    if (buffer == NULL || sim_mems.count(buffer) == 0 || buffer->parent) {
+        status = CL_INVALID_MEM_OBJECT;
+    } else if (buffer_create_type != CL_BUFFER_CREATE_TYPE_REGION || region == NULL ||
+               region->size == 0 || region->origin + region->size > buffer->size) {
+        status = CL_INVALID_VALUE;
+    } else if (region->origin % SIM_ALIGN) {
+        status = CL_MISALIGNED_SUB_BUFFER_OFFSET;
+    } else if ((m = (cl_mem)calloc(1, sizeof(struct _cl_mem))) == NULL) {
+        status = CL_OUT_OF_HOST_MEMORY;
+    } else {
+        m->data = buffer->data + region->origin;
+        m->size = region->size;
+        m->parent = buffer;
+        sim_mems.insert(m);
+    }
+    if (errcode_ret) {
+        *errcode_ret = status;
+    }
+    return m;
+}
+
+cl_int clReleaseMemObject(cl_mem memobj) {
+    if (memobj == NULL || sim_mems.erase(memobj) == 0) {
+        return CL_INVALID_MEM_OBJECT;
+    }
+    if (memobj->parent == NULL) {
+        free(memobj->data);
+    }
+    free(memobj);
+    return CL_SUCCESS;
+}
+
+cl_program clCreateProgramWithBinary(cl_context context, cl_uint num_devices, const cl_device_id *device_list,
+                                     const size_t *lengths, const unsigned char **binaries,
+                                     cl_int *binary_status, cl_int *errcode_ret) {
+    // the kernels are compiled in, the binary only has to exist
+    if (binary_status) {
+        *binary_status = CL_SUCCESS;
+    }
+    if (errcode_ret) {
+        *errcode_ret = CL_SUCCESS;
+    }
+    return (cl_program)calloc(1, sizeof(struct _cl_program));
+}
+
+cl_int clBuildProgram(cl_program program, cl_uint num_devices, const cl_device_id *device_list,
+                      const char *options, void (CL_CALLBACK *pfn_notify)(cl_program, void *),
+                      void *user_data) {
+    return program ? CL_SUCCESS : CL_INVALID_PROGRAM;
+}
+
+cl_int clGetProgramBuildInfo(cl_program program, cl_device_id device, cl_program_build_info param_name,
+                             size_t param_value_size, void *param_value, size_t *param_value_size_ret) {
+    if (param_name == CL_PROGRAM_BUILD_STATUS) {
+        PUT_VALUE(cl_int, CL_SUCCESS);
+    }
+    return PUT_STRING("");
+}
+
+cl_int clReleaseProgram(cl_program program) {
+    free(program);
+    return CL_SUCCESS;
+}
+
+cl_kernel clCreateKernel(cl_program program, const char *kernel_name, cl_int *errcode_ret) {
+    native_entry entry = native_kernel(kernel_name);
+    cl_int status = CL_SUCCESS;
+    cl_kernel k = NULL;
+
+    if (entry == NULL || strlen(kernel_name) >= sizeof(k->name)) {
+        status = CL_INVALID_KERNEL_NAME;
+    } else if ((k = (cl_kernel)calloc(1, sizeof(struct _cl_kernel))) == NULL) {
+        status = CL_OUT_OF_HOST_MEMORY;
+    } else {
+        strcpy(k->name, kernel_name);
+        k->entry = entry;
+    }
+    if (errcode_ret) {
+        *errcode_ret = status;
+    }
+    return k;
+}
+
+cl_int clSetKernelArg(cl_kernel kernel, cl_uint arg_index, size_t arg_size, const void *arg_value) {
+    if (kernel == NULL) {
+        return CL_INVALID_KERNEL;
+    }
+    if (arg_index >= SIM_MAX_ARGS) {
+        return CL_INVALID_ARG_INDEX;
+    }
+    if (arg_size > SIM_MAX_VALUE) {
+        return CL_INVALID_ARG_SIZE;
+    }
+    if (arg_value == NULL) {
+        return CL_INVALID_ARG_VALUE;
+    }
+    memcpy(kernel->values[arg_index], arg_value, arg_size);
+    kernel->args[arg_index].size = arg_size;
+    return CL_SUCCESS;
+}
+
+cl_int clReleaseKernel(cl_kernel kernel) {
+    free(kernel);
+    return CL_SUCCESS;
+}
+
+cl_int clEnqueueWriteBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_write,
+                            size_t offset, size_t size, const void *ptr, cl_uint num_events_in_wait_list,
+                            const cl_event *event_wait_list, cl_event *event) {
+    return enqueue_transfer(command_queue, CMD_WRITE, buffer, blocking_write, offset, size, NULL, ptr,
+                            num_events_in_wait_list, event_wait_list, event);
+}
+
+cl_int clEnqueueReadBuffer(cl_command_queue command_queue, cl_mem buffer, cl_bool blocking_read,
+                           size_t offset, size_t size, void *ptr, cl_uint num_events_in_wait_list,
+                           const cl_event *event_wait_list, cl_event *event) {
+    return enqueue_transfer(command_queue, CMD_READ, buffer, blocking_read, offset, size, ptr, NULL,
+                            num_events_in_wait_list, event_wait_list, event);
+}
+
+cl_int clEnqueueNDRangeKernel(cl_command_queue command_queue, cl_kernel kernel, cl_uint work_dim,
+                              const size_t *global_work_offset, const size_t *global_work_size,
+                              const size_t *local_work_size, cl_uint num_events_in_wait_list,
+                              const cl_event *event_wait_list, cl_event *event) {
+    if (command_queue == NULL) {
+        return CL_INVALID_COMMAND_QUEUE;
+    }
+    if (kernel == NULL) {
+        return CL_INVALID_KERNEL;
+    }
+    sim_cmd *cmd = (sim_cmd*)calloc(1, sizeof(sim_cmd));
+    if (cmd == NULL) {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    cmd->type = CMD_KERNEL;
+    cmd->kernel = kernel;
+    // Later clSetKernelArg calls must not change a queued launch
+    memcpy(cmd->values, kernel->values, sizeof(cmd->values));
+    for (int i = 0; i < SIM_MAX_ARGS; i++) {
+        cmd->args[i].value = cmd->values[i];
+        cmd->args[i].size = kernel->args[i].size;
+        if (cmd->args[i].size == sizeof(cl_mem)) {
+            cl_mem m = *(cl_mem*)cmd->values[i];
+            cmd->args[i].mem = sim_mems.count(m) ? m->data : NULL;
+        }
+    }
+
+    host_enter();
+    cl_int status = enqueue(command_queue, cmd, num_events_in_wait_list, event_wait_list, CL_FALSE, event);
+    host_leave();
+    return status;
+}
+
+cl_int clEnqueueTask(cl_command_queue command_queue, cl_kernel kernel, cl_uint num_events_in_wait_list,
+                     const cl_event *event_wait_list, cl_event *event) {
+    size_t one = 1;
+    return clEnqueueNDRangeKernel(command_queue, kernel, 1, NULL, &one, &one, num_events_in_wait_list,
+                                  event_wait_list, event);
+}
+
+cl_int clWaitForEvents(cl_uint num_events, const cl_event *event_list) {
+    cl_uint i;
+
+    if (num_events == 0 || event_list == NULL) {
+        return CL_INVALID_VALUE;
+    }
+    host_enter();
+    for (i = 0; i < num_events; i++) {
+        event_wait(event_list[i]);
+        host_wait(event_list[i]->end);
+    }
+    host_leave();
+    return CL_SUCCESS;
+}
+
+cl_int clGetEventInfo(cl_event event, cl_event_info param_name, size_t param_value_size,
+                      void *param_value, size_t *param_value_size_ret) {
+    if (event == NULL) {
+        return CL_INVALID_EVENT;
+    }
+    if (param_name != CL_EVENT_COMMAND_EXECUTION_STATUS) {
+        return CL_INVALID_VALUE;
+    }
+    pthread_mutex_lock(&event->lock);
+    cl_int status = event->done ? CL_COMPLETE : CL_RUNNING;
+    pthread_mutex_unlock(&event->lock);
+    PUT_VALUE(cl_int, status);
+}
+
+cl_int clGetEventProfilingInfo(cl_event event, cl_profiling_info param_name, size_t param_value_size,
+                               void *param_value, size_t *param_value_size_ret) {
+    if (event == NULL) {
+        return CL_INVALID_EVENT;
+    }
+    pthread_mutex_lock(&event->lock);
+    bool done = event->done;
+    pthread_mutex_unlock(&event->lock);
+    if (!done) {
+        return CL_PROFILING_INFO_NOT_AVAILABLE;
+    }
+    switch (param_name) {
+    case CL_PROFILING_COMMAND_QUEUED:
+    case CL_PROFILING_COMMAND_SUBMIT:
+        PUT_VALUE(cl_ulong, event->queued);
+    case CL_PROFILING_COMMAND_START:
+        PUT_VALUE(cl_ulong, event->start);
+    case CL_PROFILING_COMMAND_END:
+        PUT_VALUE(cl_ulong, event->end);
+    }
+    return CL_INVALID_VALUE;
+}
+
+cl_int clReleaseEvent(cl_event event) {
+    if (event == NULL) {
+        return CL_INVALID_EVENT;
+    }
+    event_release(event);
+    return CL_SUCCESS;
+}
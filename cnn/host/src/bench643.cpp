@@ -0,0 +1,427 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Host-side benchmark that builds without the OpenCL SDK (make bench).
+ * It times data generation, the layout transforms, the golden
+ * reference, the CPU engine (cpuconv643.h) and the native kernels
+ * (native643.h) on one layer, and verifies both engines against the
+ * reference.  Every stage runs -reps times and reports its best time;
+ * a mismatch exits with status 1.  Builds that read the layer sizes at
+ * run time (FIX_*=0) also check a cnn_jobs table of two layer shapes.
+ *
+ * Usage: bin/bench [-batch=n] [-reps=n] [-threads=n] [-tb=n]
+ *                  [-k= -s= -rofm= -cofm= -mofm= -nifm= -groups= -pad=]
+ * Layer sizes fixed by kernel643.h stay fixed, like in the host.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "util643.h"
+#include "instance643.h"
+#include "kernel643.h"
+#include "layout643.h"
+#include "cpuconv643.h"
+#include "native643.h"
+#include "ref643.h"
+
+static double bench_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1.0e-9;
+}
+
+// Reads -name=value, false if it is not given
+static bool bench_option(int argc, char **argv, const char *name, uint64_t *value) {
+    size_t len = strlen(name);
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && strncmp(argv[i] + 1, name, len) == 0 && argv[i][len + 1] == '=') {
+            *value = strtoull(argv[i] + len + 2, NULL, 10);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void size_option(int argc, char **argv, const char *name, bool fixed, uint64_t *value) {
+    uint64_t v;
+
+    if (bench_option(argc, argv, name, &v)) {
+        if (fixed) {
+            printf("%s is fixed by kernel643.h.\n", name);
+        } else {
+            *value = v;
+        }
+    }
+}
+
+static cnndata_t* bench_alloc(uint64_t n) {
+    void *p = NULL;
+
+    if (posix_memalign(&p, 64, n * sizeof(cnndata_t)) != 0) {
+        perror("Failed malloc of benchmark tensor");
+        exit(1);
+    }
+    return (cnndata_t*)p;
+}
+
+// Outputs of out (ARRAY4) that differ from ref
+static uint64_t mismatches(const cnndata_t *ref, const cnndata_t *out, uint64_t n) {
+    uint64_t i, bad = 0;
+
+    for (i = 0; i < n; i++) {
+        bad += !nearlyEqual(out[i], ref[i]);
+    }
+    return bad;
+}
+
+// Device geometry of a layer, see EXACT_TILES in kernel643.h
+static layer_size device_layer(const layer_size *layer, const kernel_size *tiles) {
+    layer_size dev = *layer;
+
+    if (EXACT_TILES) {
+        dev.R_ofm = ROUND_UP(layer->R_ofm, tiles->Tr);
+        dev.C_ofm = ROUND_UP(layer->C_ofm, tiles->Tc);
+        dev.M_ofm = ROUND_UP(layer->M_ofm, tiles->Tm);
+        dev.N_ifm = ROUND_UP(layer->N_ifm, tiles->Tn);
+        dev.R_ifm = dev.R_ofm * dev.S_wts + dev.K_wts - dev.S_wts - 2 * dev.pad_top;
+        dev.C_ifm = dev.C_ofm * dev.S_wts + dev.K_wts - dev.S_wts - 2 * dev.pad_left;
+        dev.m_end = dev.M_ofm;
+    }
+    return dev;
+}
+
+#if JOB_TABLE > 0
+// Runs one cnn_jobs launch of two jobs of different shapes, layer and
+// a 1x1 layer on its output shape, whose tensors follow each other in
+// shared input, weight and output buffers, so the second job reads and
+// writes at non-zero offsets.  Returns the outputs that differ from the
+// reference.
+static uint64_t bench_job_table(const layer_size *layer, uint64_t batch, const kernel_size *tiles) {
+    layer_size ref[2] = { *layer, *layer };
+    layer_size dev[2];
+    cnn_job jobs[2];
+    cnndata_t *ref_input[2], *ref_weights[2], *ref_output[2];
+    uint64_t num_input = 0, num_weights = 0, num_output = 0, num_jobs = 2, bad = 0, i, j, iter;
+
+    ref[1].K_wts = 1; ref[1].S_wts = 1; ref[1].groups = 1;
+    ref[1].pad_top = 0; ref[1].pad_left = 0;
+    ref[1].N_ifm = layer->M_ofm; ref[1].M_ofm = layer->N_ifm;
+    ref[1].R_ifm = layer->R_ofm; ref[1].C_ifm = layer->C_ofm;
+    ref[1].m_first = 0; ref[1].m_end = ref[1].M_ofm;
+
+    for (j = 0; j < 2; j++) {
+        dev[j] = device_layer(&ref[j], tiles);
+        jobs[j].input_offset = num_input;
+        jobs[j].weight_offset = num_weights;
+        jobs[j].output_offset = num_output;
+        jobs[j].batch_size = batch;
+        jobs[j].layer = dev[j];
+        num_input += SIZEi(batch, dev[j].N_ifm, dev[j].R_ifm, dev[j].C_ifm);
+        num_weights += SIZEw(dev[j].M_ofm, dev[j].N_ifm / dev[j].groups, dev[j].K_wts, dev[j].K_wts);
+        num_output += SIZEo(batch, dev[j].M_ofm, dev[j].R_ofm, dev[j].C_ofm);
+    }
+
+    cnndata_t *dev_input = bench_alloc(num_input);
+    cnndata_t *dev_weights = bench_alloc(num_weights);
+    cnndata_t *dev_output = bench_alloc(num_output);
+    memset(dev_output, 0, num_output * sizeof(cnndata_t));
+
+    for (j = 0; j < 2; j++) {
+        const layer_size *l = &ref[j];
+        uint64_t Ng = l->N_ifm / l->groups;
+        uint64_t num_ref_input = batch * l->N_ifm * l->R_ifm * l->C_ifm;
+        uint64_t num_ref_weights = l->M_ofm * Ng * l->K_wts * l->K_wts;
+        uint64_t num_ref_output = batch * l->M_ofm * l->R_ofm * l->C_ofm;
+
+        ref_input[j] = bench_alloc(num_ref_input);
+        ref_weights[j] = bench_alloc(num_ref_weights);
+        ref_output[j] = bench_alloc(num_ref_output);
+        for (i = 0; i < num_ref_input; i++) {
+            ref_input[j][i] = ((cnndata_t)(rand() % RANGE)) / RANGE;
+        }
+        for (i = 0; i < num_ref_weights; i++) {
+            ref_weights[j][i] = ((cnndata_t)(rand() % RANGE)) / RANGE;
+        }
+        act_to_device(ref_input[j], dev_input + jobs[j].input_offset, batch, l->N_ifm, l->R_ifm, l->C_ifm,
+                      dev[j].N_ifm, dev[j].R_ifm, dev[j].C_ifm, TN);
+        wts_to_device(ref_weights[j], dev_weights + jobs[j].weight_offset, l->M_ofm, Ng, l->K_wts,
+                      dev[j].M_ofm, dev[j].N_ifm / dev[j].groups);
+
+        memset(ref_output[j], 0, num_ref_output * sizeof(cnndata_t));
+        for (iter = 0; iter < batch; iter++) {
+            ref_conv(&ARRAY4(ref_input[j], iter, 0, 0, 0, batch, l->N_ifm, l->R_ifm, l->C_ifm),
+                     &ARRAY4(ref_output[j], iter, 0, 0, 0, batch, l->M_ofm, l->R_ofm, l->C_ofm),
+                     ref_weights[j], l);
+        }
+    }
+
+    // The arguments cnn_jobs gets from the host, see launch_jobs() in main.cpp
+    native_arg args[6];
+    memset(args, 0, sizeof(args));
+    args[0].mem = dev_input;
+    args[1].mem = dev_weights;
+    args[2].mem = dev_output;
+    args[3].value = &num_jobs; args[3].size = sizeof(num_jobs);
+    args[4].value = tiles; args[4].size = sizeof(*tiles);
+    args[5].mem = jobs;
+    native_kernel("cnn_jobs")(args);
+
+    for (j = 0; j < 2; j++) {
+        const layer_size *l = &ref[j];
+        uint64_t num_ref_output = batch * l->M_ofm * l->R_ofm * l->C_ofm;
+        cnndata_t *output = bench_alloc(num_ref_output);
+
+        act_from_device(dev_output + jobs[j].output_offset, output, batch, l->M_ofm, l->R_ofm, l->C_ofm,
+                        dev[j].M_ofm, dev[j].R_ofm, dev[j].C_ofm, TM);
+        bad += mismatches(ref_output[j], output, num_ref_output);
+        free(output);
+        free(ref_input[j]);
+        free(ref_weights[j]);
+        free(ref_output[j]);
+    }
+    free(dev_input);
+    free(dev_weights);
+    free(dev_output);
+    return bad;
+}
+#endif
+
+// Best time of a stage, with its rate per second when amount > 0
+static void report(const char *stage, double time, double amount, const char *unit) {
+    printf("  %-30s %10.5f s", stage, time);
+    if (amount > 0 && time > 0) {
+        printf("   %8.2f %s", amount / time / 1.0e9, unit);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    layer_size layer;
+    uint64_t batch = BATCH_SIZE, reps = 3, tb = 1, threads = 0, rep, iter, i;
+
+    layer.K_wts = K_WTS; layer.S_wts = S_WTS;
+    layer.R_ofm = R_OFM; layer.C_ofm = C_OFM; layer.M_ofm = M_OFM;
+    layer.N_ifm = N_IFM; layer.groups = G_GRP;
+    layer.pad_top = P_TOP; layer.pad_left = P_LEFT;
+
+    bench_option(argc, argv, "batch", &batch);
+    bench_option(argc, argv, "reps", &reps);
+    bench_option(argc, argv, "tb", &tb);
+    if (bench_option(argc, argv, "threads", &threads)) {
+        host_threads = threads;
+    }
+    size_option(argc, argv, "k", FIX_K, &layer.K_wts);
+    size_option(argc, argv, "s", FIX_S, &layer.S_wts);
+    size_option(argc, argv, "rofm", FIX_R, &layer.R_ofm);
+    size_option(argc, argv, "cofm", FIX_C, &layer.C_ofm);
+    size_option(argc, argv, "mofm", FIX_M, &layer.M_ofm);
+    size_option(argc, argv, "nifm", FIX_N, &layer.N_ifm);
+    size_option(argc, argv, "groups", FIX_G, &layer.groups);
+    size_option(argc, argv, "pad", FIX_P, &layer.pad_top);
+    layer.pad_left = layer.pad_top;
+
+    if (batch == 0 || reps == 0 || tb == 0) {
+        printf("ERROR: -batch, -reps and -tb must be at least 1\n");
+        exit(1);
+    }
+    if (layer.groups == 0 || layer.M_ofm % layer.groups != 0 || layer.N_ifm % layer.groups != 0) {
+        printf("ERROR: groups=%lu must divide mofm=%lu and nifm=%lu\n", layer.groups, layer.M_ofm,
+               layer.N_ifm);
+        exit(1);
+    }
+    if (2 * layer.pad_top >= layer.R_ofm * layer.S_wts + layer.K_wts - layer.S_wts ||
+        2 * layer.pad_left >= layer.C_ofm * layer.S_wts + layer.K_wts - layer.S_wts) {
+        printf("ERROR: padding %lu x %lu leaves no input pixels\n", layer.pad_top, layer.pad_left);
+        exit(1);
+    }
+    if (EXACT_TILES && layer.groups > 1) {
+        printf("ERROR: groups=%lu needs EXACT_TILES=0, tile padding would cross groups\n", layer.groups);
+        exit(1);
+    }
+    layer.R_ifm = layer.R_ofm * layer.S_wts + layer.K_wts - layer.S_wts - 2 * layer.pad_top;
+    layer.C_ifm = layer.C_ofm * layer.S_wts + layer.K_wts - layer.S_wts - 2 * layer.pad_left;
+    layer.m_first = 0;
+    layer.m_end = layer.M_ofm;
+    layer.b_first = 0;
+
+    kernel_size tiles = { TM, TR, TC, TN, tb };
+    layer_size dev = device_layer(&layer, &tiles);
+
+    // The line-buffer kernel is sized at compile time, see kernel643.h
+    bool native = NATIVE_KERNELS;
+    if (CONV_ENGINE == ENGINE_LINEBUF && (dev.S_wts != 1 || dev.pad_top > 0 || dev.pad_left > 0 ||
+                                          dev.K_wts > LB_MAX_K || dev.C_ifm > LB_MAX_C ||
+                                          tiles.Tm > LB_MAX_TM || tiles.Tn > LB_MAX_TN)) {
+        printf("Native kernels: skipped, the line-buffer kernel does not hold this layer\n");
+        native = false;
+    }
+
+    uint64_t Ng = layer.N_ifm / layer.groups;
+    uint64_t num_ref_input = batch * layer.N_ifm * layer.R_ifm * layer.C_ifm;
+    uint64_t num_ref_weights = layer.M_ofm * Ng * layer.K_wts * layer.K_wts;
+    uint64_t num_ref_output = batch * layer.M_ofm * layer.R_ofm * layer.C_ofm;
+    uint64_t num_dev_input = SIZEi(batch, dev.N_ifm, dev.R_ifm, dev.C_ifm);
+    uint64_t num_dev_weights = SIZEw(dev.M_ofm, dev.N_ifm / dev.groups, dev.K_wts, dev.K_wts);
+    uint64_t num_dev_output = SIZEo(batch, dev.M_ofm, dev.R_ofm, dev.C_ofm);
+    double ops = 2.0 * num_ref_output * Ng * layer.K_wts * layer.K_wts;
+
+    printf("Layer: k=%lu s=%lu rofm=%lu cofm=%lu mofm=%lu nifm=%lu groups=%lu pad=%lu, batch %lu\n",
+           layer.K_wts, layer.S_wts, layer.R_ofm, layer.C_ofm, layer.M_ofm, layer.N_ifm, layer.groups,
+           layer.pad_top, batch);
+    printf("Layouts: ACT_LAYOUT=%d WTS_LAYOUT=%d EXACT_TILES=%d, %lu reps\n\n", ACT_LAYOUT, WTS_LAYOUT,
+           EXACT_TILES, reps);
+
+    cnndata_t *ref_input = bench_alloc(num_ref_input);
+    cnndata_t *ref_weights = bench_alloc(num_ref_weights);
+    cnndata_t *ref_output = bench_alloc(num_ref_output);
+    cnndata_t *dev_input = bench_alloc(num_dev_input);
+    cnndata_t *dev_weights = bench_alloc(num_dev_weights);
+    cnndata_t *dev_output = bench_alloc(num_dev_output);
+    cnndata_t *output = bench_alloc(num_ref_output);
+
+    // Best times over the repetitions
+    double t_gen = 0, t_input = 0, t_weights = 0, t_output = 0, t_ref = 0, t_cpu = 0, t_native = 0,
+           t_verify = 0, t0, t;
+    uint64_t bad_cpu = 0, bad_native = 0, bad_jobs = 0;
+
+#define BEST(best, time) ((best) = (rep == 0 || (time) < (best)) ? (time) : (best))
+
+    for (rep = 0; rep < reps; rep++) {
+        // Data generation, like init_problem in main.cpp
+        t0 = bench_time();
+        for (i = 0; i < num_ref_input; i++) {
+            ref_input[i] = ((cnndata_t)(rand() % RANGE)) / RANGE;
+        }
+        for (i = 0; i < num_ref_weights; i++) {
+            ref_weights[i] = ((cnndata_t)(rand() % RANGE)) / RANGE;
+        }
+        t = bench_time() - t0; BEST(t_gen, t);
+
+        // Layout transforms
+        t0 = bench_time();
+        act_to_device(ref_input, dev_input, batch, layer.N_ifm, layer.R_ifm, layer.C_ifm, dev.N_ifm,
+                      dev.R_ifm, dev.C_ifm, TN);
+        t = bench_time() - t0; BEST(t_input, t);
+
+        t0 = bench_time();
+        wts_to_device(ref_weights, dev_weights, layer.M_ofm, Ng, layer.K_wts, dev.M_ofm, dev.N_ifm / dev.groups);
+        t = bench_time() - t0; BEST(t_weights, t);
+
+        // Golden reference, one image at a time like the host's verification
+        t0 = bench_time();
+        memset(ref_output, 0, num_ref_output * sizeof(cnndata_t));
+        for (iter = 0; iter < batch; iter++) {
+            ref_conv(&ARRAY4(ref_input, iter, 0, 0, 0, batch, layer.N_ifm, layer.R_ifm, layer.C_ifm),
+                     &ARRAY4(ref_output, iter, 0, 0, 0, batch, layer.M_ofm, layer.R_ofm, layer.C_ofm),
+                     ref_weights, &layer);
+        }
+        t = bench_time() - t0; BEST(t_ref, t);
+
+        // CPU engine on the device tensors
+        memset(dev_output, 0, num_dev_output * sizeof(cnndata_t));
+        t0 = bench_time();
+        cpu_conv(dev_input, dev_weights, dev_output, batch, &dev);
+        t = bench_time() - t0; BEST(t_cpu, t);
+
+        t0 = bench_time();
+        act_from_device(dev_output, output, batch, layer.M_ofm, layer.R_ofm, layer.C_ofm, dev.M_ofm,
+                        dev.R_ofm, dev.C_ofm, TM);
+        t = bench_time() - t0; BEST(t_output, t);
+
+        t0 = bench_time();
+        bad_cpu += mismatches(ref_output, output, num_ref_output);
+        t = bench_time() - t0; BEST(t_verify, t);
+
+        // Native kernels on the same tensors
+        if (native) {
+            memset(dev_output, 0, num_dev_output * sizeof(cnndata_t));
+            t0 = bench_time();
+            native_launch(CONV_ENGINE, dev_input, dev_weights, dev_output, batch, num_dev_input / batch,
+                          num_dev_output / batch, &tiles, &dev);
+            t = bench_time() - t0; BEST(t_native, t);
+
+            act_from_device(dev_output, output, batch, layer.M_ofm, layer.R_ofm, layer.C_ofm, dev.M_ofm,
+                            dev.R_ofm, dev.C_ofm, TM);
+            bad_native += mismatches(ref_output, output, num_ref_output);
+        }
+    }
+
+    printf("===== Best of %lu ======\n\n", reps);
+    report("data generation", t_gen, (num_ref_input + num_ref_weights) * sizeof(cnndata_t), "GB/s");
+    report("input to device layout", t_input, num_ref_input * sizeof(cnndata_t), "GB/s");
+    report("weights to device layout", t_weights, num_ref_weights * sizeof(cnndata_t), "GB/s");
+    report("output from device layout", t_output, num_ref_output * sizeof(cnndata_t), "GB/s");
+    report("reference conv", t_ref, ops, "GFLOP/s");
+    report("CPU engine", t_cpu, ops, "GFLOP/s");
+    if (native) {
+        report("native kernels", t_native, ops, "GFLOP/s");
+    }
+    report("verification", t_verify, num_ref_output * sizeof(cnndata_t), "GB/s");
+    printf("\n");
+
+    // The job layers differ in size, only a kernel reading every layer
+    // size at run time runs them as given
+#if JOB_TABLE > 0
+    if (native && !(FIX_K || FIX_S || FIX_R || FIX_C || FIX_M || FIX_N || FIX_G || FIX_P)) {
+        bad_jobs = bench_job_table(&layer, batch, &tiles);
+        printf("Job table of two layer shapes: %lu outputs differ\n\n", bad_jobs);
+    }
+#endif
+
+    free(ref_input);
+    free(ref_weights);
+    free(ref_output);
+    free(dev_input);
+    free(dev_weights);
+    free(dev_output);
+    free(output);
+
+    if (bad_cpu > 0 || bad_native > 0 || bad_jobs > 0) {
+        printf("Result does not match reference: %lu outputs of the CPU engine, %lu of the native kernels "
+               "over %lu reps, %lu of the job table\n", bad_cpu, bad_native, reps, bad_jobs);
+        return 1;
+    }
+    printf("Results correct.\n");
+    return 0;
+}
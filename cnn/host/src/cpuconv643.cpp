@@ -0,0 +1,126 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * CPU convolution engine, see cpuconv643.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpuconv643.h"
+#include "layout643.h"
+
+typedef struct conv_job {
+    const cnndata_t *input;
+    const cnndata_t *weights;
+    cnndata_t *output;
+    uint64_t batch;
+    const layer_size *layer;
+} conv_job;
+
+// One output row per (image, channel) unit is accumulated in acc across
+// every input channel and tap.  The taps of a row index the input row
+// with a fixed column step, so the inner loop is a strided axpy over
+// the output columns whose taps fall inside the image.
+static void conv_units(uint64_t begin, uint64_t end, void *arg) {
+    conv_job *job = (conv_job*)arg;
+    const layer_size *l = job->layer;
+    uint64_t M = l->M_ofm, N = l->N_ifm, K = l->K_wts, S = l->S_wts;
+    uint64_t R = l->R_ofm, C = l->C_ofm, R_in = l->R_ifm, C_in = l->C_ifm;
+    uint64_t Mg = M / l->groups, Ng = N / l->groups, Mr = l->m_end - l->m_first;
+    uint64_t u;
+
+    // Column step of a row in each device layout
+    uint64_t in_step = &ARRAYi(job->input, 0, 0, 0, 1, job->batch, N, R_in, C_in) - &ARRAYi(job->input, 0, 0, 0, 0, job->batch, N, R_in, C_in);
+    uint64_t out_step = &ARRAYo(job->output, 0, 0, 0, 1, job->batch, M, R, C) - &ARRAYo(job->output, 0, 0, 0, 0, job->batch, M, R, C);
+
+    cnndata_t *acc = (cnndata_t*)malloc(C * sizeof(cnndata_t));
+    if (acc == NULL) {
+        perror("Failed malloc of CPU convolution row");
+        exit(1);
+    }
+
+    for (u = begin; u < end; u++) {
+        uint64_t b = u / Mr, m = l->m_first + u % Mr;
+        uint64_t n0 = (m / Mg) * Ng;
+        uint64_t r, c, n, i, j;
+
+        for (r = 0; r < R; r++) {
+            cnndata_t *out = &ARRAYo(job->output, b, m, r, 0, job->batch, M, R, C);
+            for (c = 0; c < C; c++) {
+                acc[c] = out[c * out_step];
+            }
+
+            for (n = 0; n < Ng; n++) {
+                for (i = 0; i < K; i++) {
+                    // above or below the image the unsigned row wraps past the end
+                    uint64_t ir = S * r + i - l->pad_top;
+                    if (ir >= R_in) {
+                        continue;
+                    }
+                    const cnndata_t *in = &ARRAYi(job->input, b, n0 + n, ir, 0, job->batch, N, R_in, C_in);
+
+                    for (j = 0; j < K; j++) {
+                        cnndata_t w = ARRAYw(job->weights, m, n, i, j, M, Ng, K, K);
+                        // columns whose tap S * c + j - pad_left is inside the image
+                        uint64_t c_lo = l->pad_left > j ? CEIL_DIV(l->pad_left - j, S) : 0;
+                        uint64_t c_hi = C_in + l->pad_left > j ? MIN(C, CEIL_DIV(C_in + l->pad_left - j, S)) : 0;
+                        const cnndata_t *tap = in + (S * c_lo + j - l->pad_left) * in_step;
+
+                        for (c = c_lo; c < c_hi; c++, tap += S * in_step) {
+                            acc[c] += w * *tap;
+                        }
+                    }
+                }
+            }
+
+            for (c = 0; c < C; c++) {
+                out[c * out_step] = acc[c];
+            }
+        }
+    }
+    free(acc);
+}
+
+void cpu_conv(const cnndata_t *input, const cnndata_t *weights, cnndata_t *output, uint64_t batch,
+              const layer_size *layer) {
+    conv_job job = { input, weights, output, batch, layer };
+
+    parallel_for(batch * (layer->m_end - layer->m_first), conv_units, &job);
+}
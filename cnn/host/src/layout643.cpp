@@ -0,0 +1,540 @@
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Host layout conversions, see layout643.h
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+#include "layout643.h"
+
+#define MAX_HOST_THREADS 64
+#define TRANSPOSE_TILE   64 // cache block of transpose2d, multiple of 4
+
+unsigned host_threads = 0;
+
+typedef struct parallel_task {
+    void (*fn)(uint64_t, uint64_t, void*);
+    void *ctx;
+    uint64_t begin;
+    uint64_t end;
+} parallel_task;
+
+static void* parallel_worker(void *arg) {
+    parallel_task *task = (parallel_task*)arg;
+    task->fn(task->begin, task->end, task->ctx);
+    return NULL;
+}
+
+void parallel_for(uint64_t n, void (*fn)(uint64_t, uint64_t, void*), void *ctx) {
+    uint64_t num_threads = host_threads ? host_threads : sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = MIN(MIN(num_threads, (uint64_t)MAX_HOST_THREADS), n);
+
+    if (num_threads <= 1) {
+        fn(0, n, ctx);
+        return;
+    }
+
+    pthread_t threads[MAX_HOST_THREADS];
+    parallel_task tasks[MAX_HOST_THREADS];
+    uint64_t t;
+
+    for (t = 0; t < num_threads; t++) {
+        tasks[t].fn = fn;
+        tasks[t].ctx = ctx;
+        tasks[t].begin = n * t / num_threads;
+        tasks[t].end = n * (t + 1) / num_threads;
+    }
+    // The calling thread takes the first share
+    for (t = 1; t < num_threads; t++) {
+        if (pthread_create(&threads[t], NULL, parallel_worker, &tasks[t]) != 0) {
+            parallel_worker(&tasks[t]);
+            threads[t] = 0;
+        }
+    }
+    parallel_worker(&tasks[0]);
+    for (t = 1; t < num_threads; t++) {
+        if (threads[t]) {
+            pthread_join(threads[t], NULL);
+        }
+    }
+}
+
+static void transpose_tile(const cnndata_t *src, uint64_t src_ld, cnndata_t *dst, uint64_t dst_ld,
+                           uint64_t rows, uint64_t cols) {
+    uint64_t r = 0, c;
+
+#ifdef __SSE__
+    // cnndata_t is float: move 4x4 sub-tiles through SSE registers
+    for (; r + 4 <= rows; r += 4) {
+        for (c = 0; c + 4 <= cols; c += 4) {
+            __m128 r0 = _mm_loadu_ps(&src[(r + 0) * src_ld + c]);
+            __m128 r1 = _mm_loadu_ps(&src[(r + 1) * src_ld + c]);
+            __m128 r2 = _mm_loadu_ps(&src[(r + 2) * src_ld + c]);
+            __m128 r3 = _mm_loadu_ps(&src[(r + 3) * src_ld + c]);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&dst[(c + 0) * dst_ld + r], r0);
+            _mm_storeu_ps(&dst[(c + 1) * dst_ld + r], r1);
+            _mm_storeu_ps(&dst[(c + 2) * dst_ld + r], r2);
+            _mm_storeu_ps(&dst[(c + 3) * dst_ld + r], r3);
+        }
+        for (; c < cols; c++) {
+            dst[c * dst_ld + r + 0] = src[(r + 0) * src_ld + c];
+            dst[c * dst_ld + r + 1] = src[(r + 1) * src_ld + c];
+            dst[c * dst_ld + r + 2] = src[(r + 2) * src_ld + c];
+            dst[c * dst_ld + r + 3] = src[(r + 3) * src_ld + c];
+        }
+    }
+#endif
+    for (; r < rows; r++) {
+        for (c = 0; c < cols; c++) {
+            dst[c * dst_ld + r] = src[r * src_ld + c];
+        }
+    }
+}
+
+void transpose2d(const cnndata_t *src, uint64_t src_ld, cnndata_t *dst, uint64_t dst_ld,
+                 uint64_t rows, uint64_t cols) {
+    uint64_t r, c;
+
+    for (r = 0; r < rows; r += TRANSPOSE_TILE) {
+        for (c = 0; c < cols; c += TRANSPOSE_TILE) {
+            transpose_tile(&src[r * src_ld + c], src_ld, &dst[c * dst_ld + r], dst_ld,
+                           MIN((uint64_t)TRANSPOSE_TILE, rows - r), MIN((uint64_t)TRANSPOSE_TILE, cols - c));
+        }
+    }
+}
+
+/*
+ * Activations.  Work is split into (image, channel block) units; every
+ * layout maps a channel block [d0, d1) of one image to a transpose (or
+ * copy) that touches only that block on both sides.  When the device
+ * tensor is padded (see EXACT_TILES) each image row is moved on its
+ * own and the padding is zeroed up front by act_zero_images.
+ */
+typedef struct act_job {
+    const cnndata_t *src;
+    cnndata_t *dst;
+    uint64_t D, R, C;
+    uint64_t dev_D, dev_R, dev_C;
+    uint64_t block;
+    uint64_t blocks_per_image;
+    bool padded;
+    bool to_device;
+} act_job;
+
+static uint64_t act_dev_image(const act_job *job) {
+    const uint64_t D = ACT_LAYOUT == LAYOUT_NCHWc ? ROUND_UP(job->dev_D, job->block) : job->dev_D;
+    return D * job->dev_R * job->dev_C;
+}
+
+static void act_zero_images(uint64_t begin, uint64_t end, void *ctx) {
+    const act_job *job = (const act_job*)ctx;
+    const uint64_t dev_image = act_dev_image(job);
+
+    memset(job->dst + begin * dev_image, 0, (end - begin) * dev_image * sizeof(cnndata_t));
+}
+
+static void act_convert_units(uint64_t begin, uint64_t end, void *ctx) {
+    const act_job *job = (const act_job*)ctx;
+    const uint64_t RC = job->R * job->C;
+#if ACT_LAYOUT != LAYOUT_NHWC
+    const uint64_t dev_RC = job->dev_R * job->dev_C;
+#endif
+    const uint64_t ref_image = job->D * RC;
+    const uint64_t dev_image = act_dev_image(job);
+    // Unpadded planes are moved as a single row of R*C pixels
+    const bool spatial_pad = job->R != job->dev_R || job->C != job->dev_C;
+    const uint64_t num_rows = spatial_pad ? job->R : 1;
+    const uint64_t cols = spatial_pad ? job->C : RC;
+    uint64_t u, r;
+
+    for (u = begin; u < end; u++) {
+        uint64_t image = u / job->blocks_per_image;
+        uint64_t d0 = (u % job->blocks_per_image) * job->block;
+        uint64_t rows = MIN(job->block, job->D - d0);
+        const cnndata_t *src = job->src + image * (job->to_device ? ref_image : dev_image);
+        cnndata_t *dst = job->dst + image * (job->to_device ? dev_image : ref_image);
+
+        for (r = 0; r < num_rows; r++) {
+            // Row r of channel d0 on both sides
+            uint64_t ref_off = d0 * RC + r * job->C;
+#if ACT_LAYOUT == LAYOUT_NCHW
+            uint64_t dev_off = d0 * dev_RC + r * job->dev_C;
+            uint64_t d;
+            for (d = 0; d < rows; d++) {
+                if (job->to_device) {
+                    memcpy(&dst[dev_off + d * dev_RC], &src[ref_off + d * RC], cols * sizeof(cnndata_t));
+                } else {
+                    memcpy(&dst[ref_off + d * RC], &src[dev_off + d * dev_RC], cols * sizeof(cnndata_t));
+                }
+            }
+#elif ACT_LAYOUT == LAYOUT_NHWC
+            uint64_t dev_off = r * job->dev_C * job->dev_D + d0;
+            if (job->to_device) {
+                transpose2d(&src[ref_off], RC, &dst[dev_off], job->dev_D, rows, cols);
+            } else {
+                transpose2d(&src[dev_off], job->dev_D, &dst[ref_off], RC, cols, rows);
+            }
+#elif ACT_LAYOUT == LAYOUT_NCHWc
+            const uint64_t b = job->block;
+            uint64_t dev_off = d0 * dev_RC + r * job->dev_C * b;
+            if (job->to_device) {
+                transpose2d(&src[ref_off], RC, &dst[dev_off], b, rows, cols);
+            } else {
+                transpose2d(&src[dev_off], b, &dst[ref_off], RC, cols, rows);
+            }
+#endif
+        }
+
+#if ACT_LAYOUT == LAYOUT_NCHWc
+        if (job->to_device && rows < job->block && !job->padded) {
+            // zero the padding lanes of the last block
+            cnndata_t *blk = &dst[d0 * dev_RC];
+            uint64_t p;
+            for (p = 0; p < dev_RC; p++) {
+                memset(&blk[p * job->block + rows], 0, (job->block - rows) * sizeof(cnndata_t));
+            }
+        }
+#endif
+    }
+}
+
+static void act_convert(const cnndata_t *src, cnndata_t *dst, uint64_t num_images,
+                        uint64_t D, uint64_t R, uint64_t C, uint64_t dev_D, uint64_t dev_R,
+                        uint64_t dev_C, uint64_t block, bool to_device) {
+    act_job job;
+
+    job.src = src;
+    job.dst = dst;
+    job.D = D;
+    job.R = R;
+    job.C = C;
+    job.dev_D = dev_D;
+    job.dev_R = dev_R;
+    job.dev_C = dev_C;
+    job.block = ACT_LAYOUT == LAYOUT_NCHWc ? block : MIN(D, (uint64_t)16);
+    job.blocks_per_image = CEIL_DIV(D, job.block);
+    job.padded = D != dev_D || R != dev_R || C != dev_C;
+    job.to_device = to_device;
+
+    if (to_device && job.padded) {
+        parallel_for(num_images, act_zero_images, &job);
+    }
+    parallel_for(num_images * job.blocks_per_image, act_convert_units, &job);
+}
+
+void act_to_device(const cnndata_t *ref, cnndata_t *dev, uint64_t num_images,
+                   uint64_t D, uint64_t R, uint64_t C, uint64_t dev_D, uint64_t dev_R,
+                   uint64_t dev_C, uint64_t block) {
+    act_convert(ref, dev, num_images, D, R, C, dev_D, dev_R, dev_C, block, true);
+}
+
+void act_from_device(const cnndata_t *dev, cnndata_t *ref, uint64_t num_images,
+                     uint64_t D, uint64_t R, uint64_t C, uint64_t dev_D, uint64_t dev_R,
+                     uint64_t dev_C, uint64_t block) {
+    act_convert(dev, ref, num_images, D, R, C, dev_D, dev_R, dev_C, block, false);
+}
+
+/*
+ * Stride phases.  Split by (image, input channel); each unit moves the
+ * S*S phase planes of one channel.
+ */
+typedef struct phase_job {
+    const cnndata_t *src;
+    cnndata_t *dst;
+    uint64_t N, R, C, S;
+    uint64_t phase_R, phase_C;
+    bool to_phases;
+} phase_job;
+
+static void phase_convert_units(uint64_t begin, uint64_t end, void *ctx) {
+    const phase_job *job = (const phase_job*)ctx;
+    const uint64_t S = job->S;
+    const uint64_t phase_D = job->N * S * S;
+    uint64_t u, r, c;
+
+    for (u = begin; u < end; u++) {
+        uint64_t image = u / job->N, n = u % job->N;
+
+        if (job->to_phases) {
+            // Phase positions past the input edge only meet zero weights
+            memset(&ARRAY4(job->dst, image, PHASE_D(n, 0, 0, S), 0, 0, 1, phase_D, job->phase_R, job->phase_C),
+                   0, S * S * job->phase_R * job->phase_C * sizeof(cnndata_t));
+        }
+        for (r = 0; r < job->R; r++) {
+            for (c = 0; c < job->C; c++) {
+                cnndata_t *ph = &ARRAY4(job->to_phases ? job->dst : (cnndata_t*)job->src, image,
+                                        PHASE_D(n, r, c, S), PHASE_RC(r, S), PHASE_RC(c, S),
+                                        1, phase_D, job->phase_R, job->phase_C);
+                if (job->to_phases) {
+                    *ph = ARRAY4(job->src, image, n, r, c, 1, job->N, job->R, job->C);
+                } else {
+                    ARRAY4(job->dst, image, n, r, c, 1, job->N, job->R, job->C) = *ph;
+                }
+            }
+        }
+    }
+}
+
+static void phase_convert(const cnndata_t *src, cnndata_t *dst, uint64_t num_images, uint64_t N,
+                          uint64_t R, uint64_t C, uint64_t S, uint64_t phase_R, uint64_t phase_C,
+                          bool to_phases) {
+    phase_job job;
+
+    job.src = src;
+    job.dst = dst;
+    job.N = N;
+    job.R = R;
+    job.C = C;
+    job.S = S;
+    job.phase_R = phase_R;
+    job.phase_C = phase_C;
+    job.to_phases = to_phases;
+    parallel_for(num_images * N, phase_convert_units, &job);
+}
+
+void act_to_phases(const cnndata_t *ref, cnndata_t *phased, uint64_t num_images, uint64_t N,
+                   uint64_t R, uint64_t C, uint64_t S, uint64_t phase_R, uint64_t phase_C) {
+    phase_convert(ref, phased, num_images, N, R, C, S, phase_R, phase_C, true);
+}
+
+void act_from_phases(const cnndata_t *phased, cnndata_t *ref, uint64_t num_images, uint64_t N,
+                     uint64_t R, uint64_t C, uint64_t S, uint64_t phase_R, uint64_t phase_C) {
+    phase_convert(phased, ref, num_images, N, R, C, S, phase_R, phase_C, false);
+}
+
+void wts_to_phases(const cnndata_t *ref, cnndata_t *phased, uint64_t M, uint64_t N, uint64_t K,
+                   uint64_t S) {
+    const uint64_t phase_K = CEIL_DIV(K, S);
+    uint64_t to, ti, i, j;
+
+    memset(phased, 0, M * N * S * S * phase_K * phase_K * sizeof(cnndata_t));
+    for (to = 0; to < M; to++) {
+        for (ti = 0; ti < N; ti++) {
+            for (i = 0; i < K; i++) {
+                for (j = 0; j < K; j++) {
+                    ARRAY4(phased, to, PHASE_D(ti, i, j, S), PHASE_RC(i, S), PHASE_RC(j, S),
+                           M, N * S * S, phase_K, phase_K) = ARRAY4(ref, to, ti, i, j, M, N, K, K);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * im2col.  Split by (image, input channel); each unit writes the K*K
+ * rows of one channel, one output row of pixels at a time.
+ */
+typedef struct im2col_job {
+    const cnndata_t *ref;
+    cnndata_t *cols;
+    uint64_t N, R, C, K, S;
+    uint64_t R_ofm, C_ofm;
+    uint64_t pad_top, pad_left;
+} im2col_job;
+
+static void im2col_units(uint64_t begin, uint64_t end, void *ctx) {
+    const im2col_job *job = (const im2col_job*)ctx;
+    const uint64_t K = job->K, S = job->S;
+    const uint64_t P = job->R_ofm * job->C_ofm;
+    uint64_t u, i, j, row, col;
+
+    for (u = begin; u < end; u++) {
+        uint64_t image = u / job->N, ti = u % job->N;
+        const cnndata_t *plane = &ARRAY4(job->ref, image, ti, 0, 0, 1, job->N, job->R, job->C);
+
+        for (i = 0; i < K; i++) {
+            for (j = 0; j < K; j++) {
+                cnndata_t *dst = &job->cols[((image * job->N + ti) * K * K + i * K + j) * P];
+                for (row = 0; row < job->R_ofm; row++) {
+                    // Rows and columns of the zero halo wrap past R and C
+                    uint64_t r = S * row + i - job->pad_top;
+                    if (r >= job->R) {
+                        memset(&dst[row * job->C_ofm], 0, job->C_ofm * sizeof(cnndata_t));
+                        continue;
+                    }
+                    const cnndata_t *src = &plane[r * job->C];
+                    if (S == 1 && job->pad_left == 0 && j + job->C_ofm <= job->C) {
+                        memcpy(&dst[row * job->C_ofm], &src[j], job->C_ofm * sizeof(cnndata_t));
+                        continue;
+                    }
+                    for (col = 0; col < job->C_ofm; col++) {
+                        uint64_t c = S * col + j - job->pad_left;
+                        dst[row * job->C_ofm + col] = c < job->C ? src[c] : 0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void im2col(const cnndata_t *ref, cnndata_t *cols, uint64_t num_images, uint64_t N, uint64_t R,
+            uint64_t C, uint64_t K, uint64_t S, uint64_t R_ofm, uint64_t C_ofm, uint64_t pad_top,
+            uint64_t pad_left) {
+    im2col_job job;
+
+    job.ref = ref;
+    job.cols = cols;
+    job.N = N;
+    job.R = R;
+    job.C = C;
+    job.K = K;
+    job.S = S;
+    job.R_ofm = R_ofm;
+    job.C_ofm = C_ofm;
+    job.pad_top = pad_top;
+    job.pad_left = pad_left;
+    parallel_for(num_images * N, im2col_units, &job);
+}
+
+/*
+ * Weights.  Split by output channel; each unit fills the rows of one
+ * output channel using the kernel's own ARRAYw macro.
+ */
+typedef struct wts_job {
+    const cnndata_t *ref;
+    cnndata_t *dev;
+    uint64_t M, N, K;
+    uint64_t dev_M, dev_N;
+} wts_job;
+
+static void wts_convert_units(uint64_t begin, uint64_t end, void *ctx) {
+    const wts_job *job = (const wts_job*)ctx;
+    uint64_t to, ti, i, j;
+
+    for (to = begin; to < end; to++) {
+        for (ti = 0; ti < job->N; ti++) {
+            for (i = 0; i < job->K; i++) {
+                for (j = 0; j < job->K; j++) {
+                    ARRAYw(job->dev, to, ti, i, j, job->dev_M, job->dev_N, job->K, job->K) =
+                        ARRAY4(job->ref, to, ti, i, j, job->M, job->N, job->K, job->K);
+                }
+            }
+        }
+    }
+}
+
+void wts_to_device(const cnndata_t *ref, cnndata_t *dev, uint64_t M, uint64_t N, uint64_t K,
+                   uint64_t dev_M, uint64_t dev_N) {
+    if (WTS_LAYOUT_IS_REF && M == dev_M && N == dev_N) {
+        memcpy(dev, ref, M * N * K * K * sizeof(cnndata_t));
+        return;
+    }
+
+    wts_job job;
+
+    job.ref = ref;
+    job.dev = dev;
+    job.M = M;
+    job.N = N;
+    job.K = K;
+    job.dev_M = dev_M;
+    job.dev_N = dev_N;
+
+    // Blocked layouts and tile padding leave holes, which must read as zero
+    memset(dev, 0, SIZEw(dev_M, dev_N, K, K) * sizeof(cnndata_t));
+    parallel_for(M, wts_convert_units, &job);
+}
+
+/*
+ * Block-sparse weights.  The block index is built in one pass, then
+ * the kept blocks are copied split by output channel.
+ */
+typedef struct blocks_job {
+    const cnndata_t *ref;
+    const unsigned *ptr, *col;
+    cnndata_t *val;
+    uint64_t N, K;
+} blocks_job;
+
+static void blocks_copy_units(uint64_t begin, uint64_t end, void *ctx) {
+    const blocks_job *job = (const blocks_job*)ctx;
+    const uint64_t KK = job->K * job->K;
+    uint64_t to, b;
+
+    for (to = begin; to < end; to++) {
+        for (b = job->ptr[to]; b < job->ptr[to + 1]; b++) {
+            uint64_t n0 = job->col[b] * SP_BN;
+            uint64_t n = MIN((uint64_t)SP_BN, job->N - n0);
+            cnndata_t *dst = &job->val[b * SP_BN * KK];
+
+            memcpy(dst, &job->ref[(to * job->N + n0) * KK], n * KK * sizeof(cnndata_t));
+            memset(dst + n * KK, 0, (SP_BN - n) * KK * sizeof(cnndata_t));
+        }
+    }
+}
+
+uint64_t wts_to_blocks(const cnndata_t *ref, cnndata_t *dev, uint64_t M, uint64_t N, uint64_t K,
+                       uint64_t *kept) {
+    const uint64_t KK = K * K, blocks = CEIL_DIV(N, SP_BN);
+    unsigned *ptr = (unsigned*)dev;
+    unsigned *col = ptr + M + 1;
+    uint64_t to, cb, e, nnz = 0;
+    blocks_job job;
+
+    for (to = 0; to < M; to++) {
+        ptr[to] = nnz;
+        for (cb = 0; cb < blocks; cb++) {
+            const cnndata_t *w = &ref[(to * N + cb * SP_BN) * KK];
+            uint64_t len = MIN((uint64_t)SP_BN, N - cb * SP_BN) * KK;
+            for (e = 0; e < len && w[e] == 0; e++);
+            if (e < len) {
+                col[nnz++] = cb;
+            }
+        }
+    }
+    ptr[M] = nnz;
+
+    job.ref = ref;
+    job.ptr = ptr;
+    job.col = col;
+    job.val = dev + M + 1 + nnz;
+    job.N = N;
+    job.K = K;
+    parallel_for(M, blocks_copy_units, &job);
+
+    *kept = nnz;
+    return M + 1 + nnz + nnz * SP_BN * KK;
+}
@@ -36,21 +36,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <limits.h>
+#include <unistd.h>
 #include "CL/opencl.h"
 #include "AOCLUtils/aocl_utils.h"
 #include "util643.h"
 #include "instance643.h"
 #include "kernel643.h"
+#include "tensorio643.h"
+#include "layout643.h"
+#include "variants643.h"
+#include "zrle643.h"
+#include "cpuconv643.h"
+#include "native643.h"
+#include "ref643.h"
 #include "assert.h"
 #include "float.h"
 
 using namespace aocl_utils;
 
-/* Default 4D array layout used by validation input and output.
- * See kernel.h for kernel specific layout of input, output 
- * and weights. */
-#define ARRAY4(ptr,i4,i3,i2,i1,d4,d3,d2,d1) ((ptr)[(i4)*(d3)*(d2)*(d1)+(i3)*(d2)*(d1)+(i2)*(d1)+(i1)])
-
 #define ACL_ALIGNMENT 64
 
 void* acl_aligned_malloc (size_t size) {
@@ -64,9 +68,74 @@ void acl_aligned_free (void *ptr) {
     free (ptr);
 }
 
-#define AOCX_FILE "cnn.aocx"
+// Host pointers at this alignment can be DMA'd without a bounce copy
+bool is_dma_aligned (const void *ptr) {
+    return ptr != NULL && ((uintptr_t)ptr % ACL_ALIGNMENT) == 0;
+}
 
-#define NUM_KERNELS             1
+// Kernel binary prefix, the simulated device build (make sim) uses its own
+#ifndef AOCX_PREFIX
+#define AOCX_PREFIX "cnn"
+#endif
+// The simulated device runs the kernels compiled into the host (make sim)
+#ifndef SIM_DEVICE
+#define SIM_DEVICE (0)
+#endif
+#define VARIANTS_FILE "cnn_variants.txt"
+
+// Tile loop order of the loaded kernel, outermost first (-order=), see
+// LOOP_ORDER in kernel643.h
+int loop_order[NUM_TILE_LOOPS] = { LOOP_ROW, LOOP_COL, LOOP_TO, LOOP_TI };
+
+// Kernel binary, resolved with getBoardBinaryFile().  With a variant
+// manifest (-variants=, see variants643.h) the most specialized binary
+// that fits the layer is used instead of this build's FIX_* settings.
+std::string aocx_prefix = AOCX_PREFIX;
+std::string variants_file = VARIANTS_FILE;
+std::vector<kernel_variant> variants;
+int selected_variant = -1;
+
+// Convolution engine of the loaded kernel, see CONV_ENGINE in kernel643.h.
+// -engine=gemm runs cnn_gemm instead, -engine=pointwise cnn_pointwise and
+// -engine=sparse cnn_sparse.  -engine=auto (the default) sends
+// K_wts == 1 and R_ofm == C_ofm == 1 layers to cnn_pointwise and
+// otherwise picks the engine with fewer modeled MAC-array cycles.
+int conv_engine = CONV_ENGINE;
+std::string engine_option = "auto";
+double direct_cycles = 0, gemm_cycles = 0;
+
+// -prune=f zeroes a fraction f of the SP_BN-channel weight blocks of the
+// generated weights, as in a pruned model.  sparse_blocks_kept counts
+// the blocks cnn_sparse runs, see wts_to_blocks in layout643.h.
+double prune_fraction = 0;
+uint64_t sparse_blocks_kept = 0;
+
+// Zero run-length activation transport (-zrle), see zrle643.h.  Chunk
+// inputs and outputs cross PCIe packed in zrle_buf and are unpacked and
+// packed on the device by cnn_unzrle / cnn_zrle.  -zeros=f makes a
+// fraction f of the generated input activations zero, as after a ReLU.
+bool zrle = false;
+double zeros_fraction = 0;
+cnndata_t* zrle_host = NULL; // host side of zrle_buf
+double zrle_dense_bytes[2] = { 0, 0 }; // to and from the device
+double zrle_packed_bytes[2] = { 0, 0 };
+double zrle_pcie_time = 0, zrle_device_time = 0, zrle_host_time = 0; // seconds
+bool persistent = false; // -persistent: cnn_persistent runs the chunks as posted jobs
+uint64_t jobs_posted = 0;
+uint64_t job_images = 0; // -jobs=n: one cnn_jobs launch per chunk, a job per n images
+std::vector<cnn_job> job_table; // jobs submitted for the next launch_jobs()
+uint64_t jobs_launched = 0, job_launches = 0;
+double cpu_share = 0; // -cpu=f: share of each chunk run by the CPU engine (cpuconv643.h)
+bool cpu_adapt = true; // re-balance cpu_share from the measured rates after each chunk
+double cpu_images = 0, cpu_time = 0; // CPU side of co-executed chunks, channel splits in part images
+double cpu_dev_images = 0, cpu_dev_time = 0; // device side of the same chunks, transfers included
+double job_launch_overhead = 0; // seconds from enqueue to clFinish beyond the kernel time
+bool native_backend = false; // -native: the kernels compiled into the host run the chunks (native643.h)
+
+// Options for sizes fixed in kernel643.h only count without a manifest
+#define FIXED_BY_BUILD(fix) ((fix) && variants.empty())
+
+#define NUM_KERNELS             NUM_CU
 #define NUM_KERNELS_TO_CREATE   NUM_KERNELS
 #define NUM_QUEUES              NUM_KERNELS
 #define NUM_QUEUES_TO_CREATE    NUM_KERNELS
@@ -80,6 +149,11 @@ cl_event kernel_exec_event[NUM_QUEUES];
 cl_mem input_buf                    = NULL;
 cl_mem weight_buf                   = NULL;
 cl_mem output_buf                   = NULL;
+cl_mem zrle_buf                     = NULL;
+cl_kernel zrle_kernel[2]            = { NULL, NULL }; // cnn_unzrle, cnn_zrle
+cl_mem job_buf                      = NULL; // JOBQ cnn_job descriptors
+cl_mem ring_buf                     = NULL; // doorbell and done count
+cl_mem job_table_buf                = NULL; // cnn_jobs descriptors of one launch
 
 cl_program program                  = NULL;
 cl_context context                  = NULL;
@@ -91,15 +165,45 @@ cl_device_id* devices               = NULL;
 bool use_emulator                   = false;
 
 const char *kernel_name[] = {
-    "cnn",
+    "cnn", "cnn_1", "cnn_2", "cnn_3",
 };
 
 cnndata_t* dt_input                     = NULL;
 cnndata_t* dt_output                    = NULL;
 cnndata_t* dt_weights                   = NULL;
+
+/* Reference (ARRAY4) views used for validation.  When the device
+ * tensors index like ARRAY4 (act_/wts_dev_is_ref), ref_weights aliases
+ * dt_weights and inputs are read from dt_input in place; otherwise
+ * ref_weights is its own copy and ref_input holds one image gathered
+ * from dt_input on the fly.  ref_output always holds a single image,
+ * so host memory stays at about one copy of the batch. */
 cnndata_t* ref_input                    = NULL;
+cnndata_t* ph_input                     = NULL; // one image in stride phases, between dt_input and ref_input
+cnndata_t* dt_im2col                    = NULL; // im2col matrices of one chunk (cnn_gemm)
+double im2col_time                      = 0; // building dt_im2col, seconds
 cnndata_t* ref_output                   = NULL;
 cnndata_t* ref_weights                  = NULL;
+uint64_t host_tensor_bytes              = 0;
+double transpose_time                   = 0; // host layout conversions, seconds
+
+// Directory the host was started from.  User paths (-input=, -weights=,
+// -output=, -wcache=, -variants=) are relative to it, the defaults
+// (AOCX file, variant manifest) to the host binary.
+std::string caller_dir;
+
+// Tensor files (-input=, -weights=, -output=), see tensorio643.h
+std::string input_file;
+std::string weights_file;
+std::string output_file;
+mapped_tensor input_map;
+mapped_tensor weights_map;
+mapped_tensor output_map;
+
+// Packed-weight cache directory (-wcache=), see packed_weights_path()
+std::string wcache_dir;
+mapped_tensor wcache_map;
+double wcache_time                      = 0; // hashing and cache file I/O, seconds
 
 
 unsigned num_devices = 0;
@@ -120,11 +224,26 @@ if (status != CL_SUCCESS)                                           \
 }     
 
 uint64_t batch_size = BATCH_SIZE;
+uint64_t chunk_size = 0; // images per device pass, 0 = derive from max alloc size
+unsigned chunk_slots = 1; // chunks input_buf and output_buf hold, 2 when -persistent overlaps them
+unsigned num_units = NUM_CU; // compute units sharing each chunk, see NUM_CU in kernel643.h
+uint64_t unit_images = 0; // most images per compute unit and chunk, set in init_opencl
+std::string partition_option = "auto"; // what the compute units split: batch, m or auto
+bool m_partition = false; // the units split the output channels of every image
+uint64_t unit_channels = 0; // output channels per compute unit when m_partition
+cl_ulong max_alloc_size = 0;
 layer_size  layer_params;
+layer_size  conv_params; // the layer the kernel runs: layer_params, or its stride phases (-phases)
+layer_size  dev_params; // conv_params padded to whole tiles under EXACT_TILES
+bool stride_phases = false; // -phases, see act_to_phases in layout643.h
+uint64_t phase_S = 1; // stride of the phase decomposition, 1 = none
 kernel_size kernel_params;
+bool act_dev_is_ref; // dt_input/dt_output index like ARRAY4
+bool wts_dev_is_ref; // dt_weights indexes like ARRAY4
 uint64_t num_elem_inputs;
 uint64_t num_elem_weights;
 uint64_t num_elem_outputs;
+uint64_t num_elem_dev_inputs; // what the kernel reads: dt_input, or im2col matrices for cnn_gemm
 
 double compute_kernel_execution_time(cl_event &event, double &start_d, double &end_d)
 {
@@ -143,16 +262,31 @@ double compute_kernel_execution_time(cl_event &event, double &start_d, double &e
 void cleanup();
 
 void ZhangIsfpga15_1_fp(cnndata_t *input, cnndata_t *output, cnndata_t *weights);
-int nearlyEqual(cnndata_t a, cnndata_t b);
 void verify(cnndata_t *ref, cnndata_t *checkit);
 
+bool plan_chunks(FILE *f_out);
 bool init_opencl(FILE *f_out);
 void init_problem();
+void pack_weights();
+cnndata_t* ref_input_image(uint64_t iter);
+void write_output();
+void zrle_write(cl_mem win, const cnndata_t *src, uint64_t n);
+void zrle_read(cl_mem win, cnndata_t *dst, uint64_t n);
+double wait_jobs(uint64_t n);
+double post_job(const cnn_job *job);
+bool layer_fits_kernel(const layer_size *layer);
+void check_job_layer(const layer_size *layer);
+void submit_job(uint64_t input_offset, uint64_t output_offset, uint64_t weight_offset, uint64_t batch,
+                const layer_size *layer);
+double launch_jobs();
 void run();
 void cleanup();
 
 void read_params(Options* options);
+void choose_variant(Options* options);
 void print_params();
+void model_traffic(uint64_t weight_passes, double *input_bytes, double *weight_bytes, double *output_bytes);
+void model_engine_cycles(double *direct, double *gemm);
 
 // Entry point.
 int main(int argc, char **argv) {
@@ -174,8 +308,8 @@ int main(int argc, char **argv) {
 
     FILE *f_out = stdout;
 
-    // Initialize OpenCL.
-    if(!init_opencl(f_out)) {
+    // Initialize OpenCL, the native kernels only need the chunk plan.
+    if(native_backend ? !plan_chunks(f_out) : !init_opencl(f_out)) {
         return -1;
     }
 
@@ -185,111 +319,491 @@ int main(int argc, char **argv) {
     // Run the kernel.
     run();
 
+    // Store the results if an output file was given.
+    write_output();
+
     // Free the resources allocated
     cleanup();
 
     return 0;
 }
 
+// path as given on the command line, made absolute against caller_dir
+std::string caller_path(const std::string &path) {
+    if (path.empty() || path[0] == '/') {
+        return path;
+    }
+    return caller_dir + "/" + path;
+}
+
 void read_params(Options* options) {
     // Set default parameters
     layer_params.K_wts = K_WTS; layer_params.S_wts = S_WTS;
     layer_params.R_ofm = R_OFM; layer_params.C_ofm = C_OFM; layer_params.M_ofm = M_OFM;
-    layer_params.N_ifm = N_IFM;
+    layer_params.N_ifm = N_IFM; layer_params.groups = G_GRP;
+    layer_params.pad_top = P_TOP; layer_params.pad_left = P_LEFT;
 
     kernel_params.Tm = TM;
     kernel_params.Tr = TR;
     kernel_params.Tc = TC;
     kernel_params.Tn = TN;
+    kernel_params.Tb = FIX_TB ? TB : 0; // 0 = chosen in init_opencl
+
+    // Defaults are relative to the host binary, like the AOCX file
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        exit(1);
+    }
+    caller_dir = cwd;
+    if (!setCwdToExeDir()) {
+        exit(1);
+    }
+    if (options->has("variants")) {
+        variants_file = caller_path(options->get<std::string>("variants"));
+    }
+    load_variant_manifest(variants_file.c_str(), variants);
+    // -native and the simulated device run the kernels compiled into the
+    // host, not a manifest binary
+    if (SIM_DEVICE || (options->has("native") && options->get<bool>("native"))) {
+        if (options->has("variants")) {
+            printf("ERROR: %s runs the kernels compiled into the host, it takes no -variants\n",
+                   SIM_DEVICE ? "the simulated device" : "-native");
+            exit(1);
+        }
+        variants.clear();
+    }
 
     // Read Kernel Params
     if (options->has("tm")) {
-        if (!FIX_TM) {      
+        if (!FIXED_BY_BUILD(FIX_TM)) {      
             kernel_params.Tm = options->get<uint64_t>("tm");
         } else {
             printf("tm is fixed by kernel643.h.\n");
         }
     }
     if (options->has("tr")) {
-        if (!FIX_TR) {      
+        if (!FIXED_BY_BUILD(FIX_TR)) {      
             kernel_params.Tr = options->get<uint64_t>("tr");
         } else {
             printf("tr is fixed by kernel643.h.\n");
         }
     }
     if (options->has("tc")) {
-        if (!FIX_TC) {      
+        if (!FIXED_BY_BUILD(FIX_TC)) {      
             kernel_params.Tc = options->get<uint64_t>("tc");
         } else {
             printf("tc is fixed by kernel643.h.\n");
         }
     }
     if (options->has("tn")) {
-        if (!FIX_TN) {      
+        if (!FIXED_BY_BUILD(FIX_TN)) {      
             kernel_params.Tn = options->get<uint64_t>("tn");
         } else {
             printf("tn is fixed by kernel643.h.\n");
         }
     }
+    if (options->has("tb")) {
+        if (!FIXED_BY_BUILD(FIX_TB)) {      
+            kernel_params.Tb = options->get<uint64_t>("tb");
+        } else {
+            printf("tb is fixed by kernel643.h.\n");
+        }
+    }
 
     // Read Layer Params
     if (options->has("k")) {
-        if (!FIX_K) {      
+        if (!FIXED_BY_BUILD(FIX_K)) {      
             layer_params.K_wts = options->get<uint64_t>("k");
         } else {
             printf("k is fixed by kernel643.h.\n");
         }
     }
     if (options->has("s")) {
-        if (!FIX_S) {      
+        if (!FIXED_BY_BUILD(FIX_S)) {      
             layer_params.S_wts = options->get<uint64_t>("s");
         } else {
             printf("s is fixed by kernel643.h.\n");
         }
     }
     if (options->has("rofm")) {
-        if (!FIX_R) {      
+        if (!FIXED_BY_BUILD(FIX_R)) {      
             layer_params.R_ofm = options->get<uint64_t>("rofm");
         } else {
             printf("rofm is fixed by kernel643.h.\n");
         }
     }
     if (options->has("cofm")) {
-        if (!FIX_C) {      
+        if (!FIXED_BY_BUILD(FIX_C)) {      
             layer_params.C_ofm = options->get<uint64_t>("cofm");
         } else {
             printf("cofm is fixed by kernel643.h.\n");
         }
     }
     if (options->has("mofm")) {
-        if (!FIX_M) {      
+        if (!FIXED_BY_BUILD(FIX_M)) {      
             layer_params.M_ofm = options->get<uint64_t>("mofm");
         } else {
             printf("mofm is fixed by kernel643.h.\n");
         }
     }
     if (options->has("nifm")) {
-        if (!FIX_N) {      
+        if (!FIXED_BY_BUILD(FIX_N)) {      
             layer_params.N_ifm = options->get<uint64_t>("nifm");
         } else {
             printf("nifm is fixed by kernel643.h.\n");
         }
     }
     
+    if (options->has("groups")) {
+        if (!FIXED_BY_BUILD(FIX_G)) {      
+            layer_params.groups = options->get<uint64_t>("groups");
+        } else {
+            printf("groups is fixed by kernel643.h.\n");
+        }
+    }
+    if (layer_params.groups == 0 || layer_params.M_ofm % layer_params.groups != 0 ||
+        layer_params.N_ifm % layer_params.groups != 0) {
+        printf("ERROR: groups=%lu must divide mofm=%lu and nifm=%lu\n", layer_params.groups,
+               layer_params.M_ofm, layer_params.N_ifm);
+        exit(1);
+    }
+    
+    if (options->has("pad") || options->has("padt") || options->has("padl")) {
+        if (!FIXED_BY_BUILD(FIX_P)) {
+            if (options->has("pad")) {
+                layer_params.pad_top = layer_params.pad_left = options->get<uint64_t>("pad");
+            }
+            if (options->has("padt")) {
+                layer_params.pad_top = options->get<uint64_t>("padt");
+            }
+            if (options->has("padl")) {
+                layer_params.pad_left = options->get<uint64_t>("padl");
+            }
+        } else {
+            printf("pad is fixed by kernel643.h.\n");
+        }
+    }
+    
     if (options->has("batch")) {
         batch_size = options->get<uint64_t>("batch");
     }
+    if (options->has("chunk")) {
+        chunk_size = options->get<uint64_t>("chunk");
+    }
+    if (options->has("cu")) {
+        num_units = options->get<unsigned>("cu");
+        if (num_units < 1 || num_units > NUM_CU) {
+            printf("ERROR: -cu=%u, the kernel was built with %d compute units\n", num_units, NUM_CU);
+            exit(1);
+        }
+    }
+    if (options->has("partition")) {
+        partition_option = options->get<std::string>("partition");
+        if (partition_option != "auto" && partition_option != "batch" && partition_option != "m") {
+            printf("ERROR: -partition=%s, expected auto, batch or m\n", partition_option.c_str());
+            exit(1);
+        }
+    }
+
+    // Tensor files, otherwise inputs and weights are synthetic
+    if (options->has("input")) {
+        input_file = caller_path(options->get<std::string>("input"));
+    }
+    if (options->has("weights")) {
+        weights_file = caller_path(options->get<std::string>("weights"));
+    }
+    if (options->has("output")) {
+        output_file = caller_path(options->get<std::string>("output"));
+    }
 
-    // Calculate dependent paramters
+    if (options->has("order")) {
+        std::string order = options->get<std::string>("order");
+        if (!parse_loop_order(order.c_str(), loop_order)) {
+            printf("ERROR: -order=%s is not a permutation of row,col,to,ti\n", order.c_str());
+            exit(1);
+        }
+        if (WTS_LAYOUT == WLAYOUT_PACKED && loop_ti_outer(loop_order) != (bool)WPACK_TI_OUTER) {
+            printf("ERROR: -order=%s, the packed weights of this host follow the to/ti nesting of "
+                   "LOOP_ORDER=%s\n", order.c_str(), TILE_ORDER_STR(LOOP_ORDER));
+            exit(1);
+        }
+        // gen_variants.sh names its binaries cnn_<order>
+        aocx_prefix = std::string(AOCX_PREFIX) + "_" + loop_name[loop_order[0]] + "_" +
+                      loop_name[loop_order[1]] + "_" + loop_name[loop_order[2]] + "_" + loop_name[loop_order[3]];
+    }
+
+    if (options->has("wcache")) {
+        wcache_dir = caller_path(options->get<std::string>("wcache"));
+    }
+
+    if (options->has("threads")) {
+        host_threads = options->get<unsigned>("threads");
+    }
+
+    if (options->has("phases")) {
+        stride_phases = options->get<bool>("phases");
+    }
+
+    if (options->has("engine")) {
+        engine_option = options->get<std::string>("engine");
+        if (engine_option != "auto" && engine_option != "direct" && engine_option != "gemm" &&
+            engine_option != "pointwise" && engine_option != "sparse") {
+            printf("ERROR: -engine=%s, expected auto, direct, gemm, pointwise or sparse\n", engine_option.c_str());
+            exit(1);
+        }
+        if (engine_option == "gemm" && GEMM_BS == 0) {
+            printf("ERROR: -engine=gemm needs a build with GEMM_BS > 0\n");
+            exit(1);
+        }
+        if (engine_option == "pointwise" && PW_BQ == 0) {
+            printf("ERROR: -engine=pointwise needs a build with PW_BQ > 0\n");
+            exit(1);
+        }
+        if (engine_option == "sparse" && SP_BN == 0) {
+            printf("ERROR: -engine=sparse needs a build with SP_BN > 0\n");
+            exit(1);
+        }
+    }
+
+    if (options->has("zrle")) {
+        zrle = options->get<bool>("zrle");
+        if (zrle && ZRLE == 0) {
+            printf("ERROR: -zrle needs a build with ZRLE > 0\n");
+            exit(1);
+        }
+    }
+    if (options->has("persistent")) {
+        persistent = options->get<bool>("persistent");
+        if (persistent && (JOBQ == 0 || zrle)) {
+            printf("ERROR: -persistent needs a build with JOBQ > 0 and no -zrle\n");
+            exit(1);
+        }
+    }
+    if (options->has("jobs")) {
+        job_images = options->get<uint64_t>("jobs");
+        if (JOB_TABLE == 0 || persistent) {
+            printf("ERROR: -jobs needs a build with JOB_TABLE > 0 and no -persistent\n");
+            exit(1);
+        }
+    }
+    if (options->has("native")) {
+        native_backend = options->get<bool>("native");
+        if (native_backend && (NATIVE_KERNELS == 0 || zrle || persistent || job_images > 0)) {
+            printf("ERROR: -native needs a build with NATIVE_KERNELS > 0 and no -zrle, -persistent or -jobs\n");
+            exit(1);
+        }
+    }
+    // Kernels compiled into the host run their tile loops in LOOP_ORDER
+    int compiled_order[NUM_TILE_LOOPS];
+    if ((native_backend || SIM_DEVICE) && parse_loop_order(TILE_ORDER_STR(LOOP_ORDER), compiled_order)) {
+        if (options->has("order") && memcmp(loop_order, compiled_order, sizeof(loop_order)) != 0) {
+            printf("ERROR: -order=%s, the %s kernels were built with LOOP_ORDER=%s\n",
+                   options->get<std::string>("order").c_str(), native_backend ? "native" : "simulated",
+                   TILE_ORDER_STR(LOOP_ORDER));
+            exit(1);
+        }
+        memcpy(loop_order, compiled_order, sizeof(loop_order));
+        aocx_prefix = AOCX_PREFIX;
+    }
+    if (options->has("cpu")) {
+        cpu_share = options->get<double>("cpu");
+        if (cpu_share < 0 || cpu_share >= 1) {
+            printf("ERROR: -cpu=%g, expected 0 <= cpu < 1\n", cpu_share);
+            exit(1);
+        }
+    }
+    if (options->has("cpu_adapt")) {
+        cpu_adapt = options->get<bool>("cpu_adapt");
+    }
+    if (options->has("zeros")) {
+        zeros_fraction = options->get<double>("zeros");
+        if (zeros_fraction < 0 || zeros_fraction > 1) {
+            printf("ERROR: -zeros=%g, expected 0 <= zeros <= 1\n", zeros_fraction);
+            exit(1);
+        }
+    }
+
+    if (options->has("prune")) {
+        prune_fraction = options->get<double>("prune");
+        if (prune_fraction < 0 || prune_fraction > 1 || SP_BN == 0) {
+            printf("ERROR: -prune=%g needs 0 <= prune <= 1 and a build with SP_BN > 0\n", prune_fraction);
+            exit(1);
+        }
+    }
+
+    // Calculate dependent paramters, the zero halo is not part of the input
+    if (2 * layer_params.pad_top >= layer_params.R_ofm * layer_params.S_wts + layer_params.K_wts - layer_params.S_wts ||
+        2 * layer_params.pad_left >= layer_params.C_ofm * layer_params.S_wts + layer_params.K_wts - layer_params.S_wts) {
+        printf("ERROR: padding %lu x %lu leaves no input pixels\n", layer_params.pad_top, layer_params.pad_left);
+        exit(1);
+    }
     layer_params.R_ifm = layer_params.R_ofm * layer_params.S_wts + 
-                            layer_params.K_wts - layer_params.S_wts;
+                            layer_params.K_wts - layer_params.S_wts - 2 * layer_params.pad_top;
     layer_params.C_ifm = layer_params.C_ofm * layer_params.S_wts + 
-                            layer_params.K_wts - layer_params.S_wts;
+                            layer_params.K_wts - layer_params.S_wts - 2 * layer_params.pad_left;
+
+    // Strided layers run as a unit-stride layer over S*S phase sub-images
+    // with ceil(K/S) weights, see act_to_phases in layout643.h
+    conv_params = layer_params;
+    if (stride_phases && layer_params.S_wts > 1) {
+        if (FIXED_BY_BUILD(FIX_K || FIX_S || FIX_N)) {
+            printf("ERROR: -phases changes k, s and nifm, build the kernel with FIX_K, FIX_S and FIX_N 0\n");
+            exit(1);
+        }
+        if (layer_params.pad_top > 0 || layer_params.pad_left > 0) {
+            printf("ERROR: -phases needs an unpadded layer\n");
+            exit(1);
+        }
+        phase_S = layer_params.S_wts;
+        conv_params.K_wts = CEIL_DIV(layer_params.K_wts, phase_S);
+        conv_params.S_wts = 1;
+        conv_params.N_ifm = layer_params.N_ifm * phase_S * phase_S;
+        conv_params.R_ifm = conv_params.R_ofm + conv_params.K_wts - 1;
+        conv_params.C_ifm = conv_params.C_ofm + conv_params.K_wts - 1;
+    }
+
+    if (!variants.empty()) {
+        choose_variant(options);
+    }
+
+    // Direct tile loops, the block-sparse kernel, the pointwise kernel or
+    // im2col + GEMM.  The last three handle any stride themselves and
+    // have no tiles to pad.  Only the direct and block-sparse kernels run
+    // grouped layers.  -persistent, -jobs and -cpu keep auto on the
+    // direct engine.
+    bool pointwise_layer = layer_params.K_wts == 1 || (layer_params.R_ofm == 1 && layer_params.C_ofm == 1);
+    bool direct_only = persistent || job_images > 0 || cpu_share > 0;
+    if (engine_option == "sparse") {
+        conv_engine = ENGINE_SPARSE;
+        kernel_name[0] = "cnn_sparse";
+        conv_params = layer_params;
+        phase_S = 1;
+    } else if (layer_params.groups > 1) {
+        if (engine_option == "gemm" || engine_option == "pointwise" || conv_engine == ENGINE_LINEBUF) {
+            printf("ERROR: groups=%lu needs the direct engine\n", layer_params.groups);
+            exit(1);
+        }
+        if (EXACT_TILES) {
+            printf("ERROR: groups=%lu needs EXACT_TILES=0, tile padding would cross groups\n",
+                   layer_params.groups);
+            exit(1);
+        }
+    } else if (PW_BQ > 0 && (engine_option == "pointwise" ||
+                             (engine_option == "auto" && pointwise_layer && !direct_only))) {
+        conv_engine = ENGINE_POINTWISE;
+        kernel_name[0] = "cnn_pointwise";
+        conv_params = layer_params;
+        phase_S = 1;
+    } else if (GEMM_BS > 0 && (engine_option == "gemm" || (engine_option == "auto" && !direct_only))) {
+        model_engine_cycles(&direct_cycles, &gemm_cycles);
+        if (engine_option == "gemm" ||
+            (conv_engine == ENGINE_DIRECT && gemm_cycles < direct_cycles)) {
+            conv_engine = ENGINE_GEMM;
+            kernel_name[0] = "cnn_gemm";
+            conv_params = layer_params;
+            phase_S = 1;
+        }
+    }
+
+    // The other engines are single kernels
+    if (conv_engine != ENGINE_DIRECT && conv_engine != ENGINE_LINEBUF) {
+        num_units = 1;
+        if (persistent || job_images > 0 || cpu_share > 0) {
+            printf("ERROR: -persistent, -jobs and -cpu run the direct or line-buffer engine only\n");
+            exit(1);
+        }
+    }
+    if (persistent) {
+        kernel_name[0] = "cnn_persistent";
+        num_units = 1;
+    }
+    if (job_images > 0) {
+        kernel_name[0] = "cnn_jobs";
+        num_units = 1;
+    }
+    if (native_backend) {
+        num_units = 1; // the host threads split the batch instead
+    }
+
+    // Device geometry, see EXACT_TILES in kernel643.h
+    dev_params = conv_params;
+    if (EXACT_TILES && (conv_engine == ENGINE_DIRECT || conv_engine == ENGINE_LINEBUF)) {
+        dev_params.R_ofm = ROUND_UP(conv_params.R_ofm, kernel_params.Tr);
+        dev_params.C_ofm = ROUND_UP(conv_params.C_ofm, kernel_params.Tc);
+        dev_params.M_ofm = ROUND_UP(conv_params.M_ofm, kernel_params.Tm);
+        dev_params.N_ifm = ROUND_UP(conv_params.N_ifm, kernel_params.Tn);
+        dev_params.R_ifm = dev_params.R_ofm * dev_params.S_wts + 
+                                dev_params.K_wts - dev_params.S_wts - 2 * dev_params.pad_top;
+        dev_params.C_ifm = dev_params.C_ofm * dev_params.S_wts + 
+                                dev_params.K_wts - dev_params.S_wts - 2 * dev_params.pad_left;
+    }
+    act_dev_is_ref = ACT_LAYOUT_IS_REF && phase_S == 1 && dev_params.N_ifm == layer_params.N_ifm &&
+                     dev_params.M_ofm == layer_params.M_ofm && dev_params.R_ofm == layer_params.R_ofm &&
+                     dev_params.C_ofm == layer_params.C_ofm;
+    wts_dev_is_ref = WTS_LAYOUT_IS_REF && phase_S == 1 && dev_params.N_ifm == layer_params.N_ifm &&
+                     dev_params.M_ofm == layer_params.M_ofm && conv_engine != ENGINE_SPARSE;
+
+    // Device tensor sizes, see SIZEi/SIZEw/SIZEo in kernel643.h
+    num_elem_inputs = SIZEi(batch_size, dev_params.N_ifm, dev_params.R_ifm, dev_params.C_ifm);
+    num_elem_weights = SIZEw(dev_params.M_ofm, dev_params.N_ifm / dev_params.groups, dev_params.K_wts, dev_params.K_wts);
+    if (conv_engine == ENGINE_SPARSE) {
+        // Bound for the weight buffer, pack_weights() sets the size of the kept blocks
+        num_elem_weights = SIZEw_SPARSE(dev_params.M_ofm, dev_params.N_ifm / dev_params.groups, dev_params.K_wts);
+    }
+    num_elem_outputs = SIZEo(batch_size, dev_params.M_ofm, dev_params.R_ofm, dev_params.C_ofm);
+    num_elem_dev_inputs = conv_engine == ENGINE_GEMM ?
+        batch_size * layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts *
+        layer_params.R_ofm * layer_params.C_ofm : num_elem_inputs;
+
+    // The line-buffer engine is sized at compile time, see kernel643.h
+    if (conv_engine == ENGINE_LINEBUF) {
+        if (dev_params.S_wts != 1) {
+            printf("ERROR: the line-buffer kernel needs s=1 (s=%lu)\n", dev_params.S_wts);
+            exit(1);
+        }
+        if (dev_params.pad_top > 0 || dev_params.pad_left > 0) {
+            printf("ERROR: the line-buffer kernel needs an unpadded layer\n");
+            exit(1);
+        }
+        if (dev_params.K_wts > LB_MAX_K || dev_params.C_ifm > LB_MAX_C ||
+            kernel_params.Tm > LB_MAX_TM || kernel_params.Tn > LB_MAX_TN) {
+            printf("ERROR: the line-buffer kernel holds k <= %d, input width <= %d, tm <= %d, tn <= %d "
+                   "(k=%lu, width=%lu, tm=%lu, tn=%lu)\n", LB_MAX_K, LB_MAX_C, LB_MAX_TM, LB_MAX_TN,
+                   dev_params.K_wts, dev_params.C_ifm, kernel_params.Tm, kernel_params.Tn);
+            exit(1);
+        }
+    }
+}
 
-    num_elem_inputs = batch_size * layer_params.N_ifm * layer_params.R_ifm * layer_params.C_ifm;
-    num_elem_weights = layer_params.M_ofm * layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts;
-    num_elem_outputs = batch_size * layer_params.M_ofm * layer_params.R_ofm * layer_params.C_ofm;
+// Picks the kernel binary from the manifest and takes its fixed tile
+// sizes and loop order
+void choose_variant(Options* options) {
+    kernel_size wanted;
+
+    wanted.Tm = options->has("tm") ? kernel_params.Tm : 0;
+    wanted.Tr = options->has("tr") ? kernel_params.Tr : 0;
+    wanted.Tc = options->has("tc") ? kernel_params.Tc : 0;
+    wanted.Tn = options->has("tn") ? kernel_params.Tn : 0;
+    wanted.Tb = options->has("tb") ? kernel_params.Tb : 0;
+
+    selected_variant = select_variant(variants, &conv_params, &wanted,
+                                      options->has("order") ? loop_order : NULL);
+    if (selected_variant < 0) {
+        printf("ERROR: no kernel in %s fits this layer (and -tm/-tn/-tr/-tc/-tb/-order)\n",
+               variants_file.c_str());
+        exit(1);
+    }
 
+    const kernel_variant *v = &variants[selected_variant];
+    if (v->tiles.Tm) kernel_params.Tm = v->tiles.Tm;
+    if (v->tiles.Tr) kernel_params.Tr = v->tiles.Tr;
+    if (v->tiles.Tc) kernel_params.Tc = v->tiles.Tc;
+    if (v->tiles.Tn) kernel_params.Tn = v->tiles.Tn;
+    kernel_params.Tb = v->tiles.Tb ? v->tiles.Tb : wanted.Tb;
+    memcpy(loop_order, v->loop_order, sizeof(loop_order));
+    aocx_prefix = v->prefix;
+    conv_engine = v->engine;
 }
 
 void print_params() {
@@ -299,9 +813,146 @@ void print_params() {
 
     printf("Layer Parameters: \nK_wts: \t%lu\tS_wts:\t%lu\nR_ofm:\t%lu\tC_ofm:\t%lu\tM_ofm:\t%lu\tN_ifm:\t%lu\n\n", 
         layer_params.K_wts, layer_params.S_wts, layer_params.R_ofm, layer_params.C_ofm, layer_params.M_ofm, layer_params.N_ifm);
+    if (layer_params.pad_top > 0 || layer_params.pad_left > 0) {
+        printf("Padding:\t%lu rows, %lu columns each side\tR_ifm:\t%lu\tC_ifm:\t%lu\n\n",
+            layer_params.pad_top, layer_params.pad_left, layer_params.R_ifm, layer_params.C_ifm);
+    }
+    if (layer_params.groups > 1) {
+        printf("Groups:\t%lu\t(%lu input channels per output channel%s)\n\n", layer_params.groups,
+            layer_params.N_ifm / layer_params.groups, layer_params.groups == layer_params.N_ifm ? ", depthwise" : "");
+    }
 
     printf("Kernel Parameters: \nTm: \t%lu\tTn:\t%lu\tTr:\t%lu\tTc:\t%lu\n\n", 
         kernel_params.Tm, kernel_params.Tn, kernel_params.Tr, kernel_params.Tc);    
+
+    static const char *act_layout_name[] = { "NCHW", "NHWC", "NCHWc" };
+    static const char *wts_layout_name[] = { "MNKK", "blocked", "packed" };
+    printf("Device Layouts: \nActivations:\t%s\tWeights:\t%s\n\n",
+        act_layout_name[ACT_LAYOUT], wts_layout_name[WTS_LAYOUT]);
+
+    static const char *engine_name[] = { "direct", "line buffer", "im2col + GEMM", "pointwise", "block-sparse" };
+    printf("Engine: \n%s", engine_name[conv_engine]);
+    if (direct_cycles > 0) {
+        printf("\t(-engine=%s, modeled cycles: direct %.0f, GEMM %.0f)", engine_option.c_str(),
+               direct_cycles, gemm_cycles);
+    }
+    printf("\n\n");
+    if (conv_engine == ENGINE_GEMM) {
+        // im2col repeats every input pixel for each window it falls in
+        double input_bytes = (double)SIZEi(1, layer_params.N_ifm, layer_params.R_ifm, layer_params.C_ifm) * sizeof(cnndata_t);
+        double im2col_bytes = (double)num_elem_dev_inputs / batch_size * sizeof(cnndata_t);
+        printf("im2col: \n%.2f MB per image vs %.2f MB input (x%.2f), GEMM_BS %d\n\n",
+               im2col_bytes / 1.0e6, input_bytes / 1.0e6, im2col_bytes / input_bytes, GEMM_BS);
+    }
+
+    printf("Tile Loop Order: \n%s,%s,%s,%s\n\n", loop_name[loop_order[0]], loop_name[loop_order[1]],
+        loop_name[loop_order[2]], loop_name[loop_order[3]]);
+
+    if (phase_S > 1) {
+        printf("Stride phases: \n%lu x %lu sub-images\tK_wts:\t%lu\tS_wts:\t1\tN_ifm:\t%lu\n\n",
+            phase_S, phase_S, conv_params.K_wts, conv_params.N_ifm);
+    }
+
+    if (EXACT_TILES) {
+        printf("Exact tiles (padded device problem): \nR_ofm:\t%lu\tC_ofm:\t%lu\tM_ofm:\t%lu\tN_ifm:\t%lu\n\n",
+            dev_params.R_ofm, dev_params.C_ofm, dev_params.M_ofm, dev_params.N_ifm);
+    }
+}
+
+// Splits the batch into chunks, the chunks between the compute units
+// and picks the batch tile.  The device limits apply unless the native
+// kernels run the chunks.
+bool plan_chunks(FILE *f_out) {
+    //----------------------------------------------
+    // Split the batch into chunks that fit one allocation
+    //----------------------------------------------
+    {
+        uint64_t image_bytes = MAX(num_elem_dev_inputs, num_elem_outputs) / batch_size * sizeof(cnndata_t);
+        if (zrle) {
+            // zrle_buf holds a chunk with every element nonzero, plus the masks
+            image_bytes += CEIL_DIV(image_bytes, ZRLE_BLOCK) + sizeof(cnndata_t);
+        }
+        uint64_t fit = max_alloc_size / image_bytes;
+
+        if (native_backend) {
+            fit = batch_size; // the native kernels run on the host tensors in place
+        } else if (fit == 0 || num_elem_weights * sizeof(cnndata_t) > max_alloc_size) {
+            printf("ERROR: a single image or the weights exceed the device max allocation size\n");
+            return false;
+        }
+        if (chunk_size == 0 || chunk_size > fit) {
+            chunk_size = fit;
+        }
+        chunk_size = MIN(chunk_size, batch_size);
+        // -persistent uploads the next chunk into a second slot of the
+        // buffers while its kernel runs this one, within one allocation
+        if (persistent && chunk_size < batch_size && fit >= 2) {
+            chunk_slots = 2;
+            chunk_size = MIN(chunk_size, fit / 2);
+        }
+        fprintf(f_out, "Batch chunking: %lu images per pass, %lu passes\n\n", chunk_size,
+                (batch_size + chunk_size - 1) / chunk_size);
+        if (chunk_slots > 1) {
+            fprintf(f_out, "Persistent jobs: %u chunk slots, each chunk uploads while the previous one runs\n\n",
+                    chunk_slots);
+        }
+    }
+
+    //----------------------------------------------
+    // Split each chunk between the compute units, every unit runs its
+    // slice of images from an image offset (b_first) in the chunk buffers.
+    //
+    // Passes with fewer images than units (single-image latency) split
+    // the output channels instead: every unit reads the whole chunk and
+    // the whole weight tensor and writes its own channels of the chunk.
+    // The ranges are whole Tm tiles.
+    //----------------------------------------------
+    {
+        m_partition = num_units > 1 &&
+            (partition_option == "m" || (partition_option == "auto" && chunk_size < num_units));
+        if (m_partition) {
+            unit_channels = MIN(ROUND_UP(CEIL_DIV(dev_params.M_ofm, num_units), kernel_params.Tm),
+                                dev_params.M_ofm);
+            num_units = CEIL_DIV(dev_params.M_ofm, unit_channels);
+            unit_images = chunk_size;
+            fprintf(f_out, "Compute units: %u of %d, %lu output channels each\n\n", num_units, NUM_CU,
+                    unit_channels);
+        } else {
+            num_units = MIN(num_units, chunk_size);
+            unit_images = CEIL_DIV(chunk_size, num_units);
+            unit_channels = dev_params.M_ofm;
+            if (NUM_CU > 1) {
+                fprintf(f_out, "Compute units: %u of %d, up to %lu images each per pass\n\n", num_units, NUM_CU,
+                        unit_images);
+            }
+        }
+    }
+
+    //----------------------------------------------
+    // Pick the batch tile.  Weight-heavy layers (deep M x N, FC-like)
+    // share each weight tile across all images of a pass; activation-
+    // heavy layers run one image at a time.
+    //----------------------------------------------
+    {
+        uint64_t image_elems = (num_elem_inputs + num_elem_outputs) / batch_size;
+        bool weight_heavy = num_elem_weights > image_elems;
+
+        if (conv_engine != ENGINE_DIRECT) {
+            kernel_params.Tb = 1; // only the direct kernel tiles the batch
+        } else if (kernel_params.Tb == 0) {
+            kernel_params.Tb = weight_heavy ? chunk_size : 1;
+        }
+        kernel_params.Tb = MIN(kernel_params.Tb, unit_images);
+        if (job_images > 0) {
+            kernel_params.Tb = MIN(kernel_params.Tb, job_images);
+        }
+        fprintf(f_out, "Batch tile: Tb = %lu (%s layer, weights %.2f MB vs %.2f MB per image)\n\n",
+                kernel_params.Tb, weight_heavy ? "weight-heavy" : "activation-heavy",
+                num_elem_weights * sizeof(cnndata_t) / 1.0e6, image_elems * sizeof(cnndata_t) / 1.0e6);
+    }
+
+
+    return true;
 }
 
 // Initializes the OpenCL objects.
@@ -414,6 +1065,14 @@ bool init_opencl(FILE *f_out) {
                         &buffer,
                         NULL);
         fprintf(f_out, "Global Memory Allocation Size: %lu\n\n", *((unsigned long*)buffer));
+
+        if (i == 0) {
+            max_alloc_size = *((unsigned long*)buffer);
+        }
+    }
+
+    if (!plan_chunks(f_out)) {
+        return false;
     }
 
 
@@ -458,11 +1117,11 @@ bool init_opencl(FILE *f_out) {
     // Create device buffers
     //----------------------------------------------
     printf("\n===== Host-CPU creating arrays in the FPGA device global memory (DDR4) ======\n\n");
-    // Input buffer.
+    // Input buffer, sized for chunk_slots chunks and reused across chunks.
     input_buf = clCreateBuffer(
             context, 
-            CL_MEM_READ_ONLY,
-            num_elem_inputs * sizeof(cnndata_t), 
+            zrle ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY,
+            num_elem_dev_inputs / batch_size * chunk_size * chunk_slots * sizeof(cnndata_t), 
             NULL, 
             &status); CHECK(status);
 
@@ -474,14 +1133,56 @@ bool init_opencl(FILE *f_out) {
             NULL, 
             &status); CHECK(status);
 
-    // Output buffer.
+    // Output buffer, sized for chunk_slots chunks and reused across chunks.
     output_buf = clCreateBuffer(
             context, 
-            CL_MEM_WRITE_ONLY,
-            num_elem_outputs * sizeof(cnndata_t), 
+            zrle ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY,
+            num_elem_outputs / batch_size * chunk_size * chunk_slots * sizeof(cnndata_t), 
             NULL, 
             &status); CHECK(status);
 
+    // Job ring of the persistent kernel
+    if (persistent) {
+        job_buf = clCreateBuffer(
+                context, 
+                CL_MEM_READ_ONLY,
+                JOBQ * sizeof(cnn_job), 
+                NULL, 
+                &status); CHECK(status);
+        ring_buf = clCreateBuffer(
+                context, 
+                CL_MEM_READ_WRITE,
+                2 * sizeof(uint64_t), 
+                NULL, 
+                &status); CHECK(status);
+    }
+
+    // Job table of one chunk
+    if (job_images > 0) {
+        job_table_buf = clCreateBuffer(
+                context, 
+                CL_MEM_READ_ONLY,
+                CEIL_DIV(chunk_size, job_images) * sizeof(cnn_job), 
+                NULL, 
+                &status); CHECK(status);
+    }
+
+    // Packed activations of one chunk window, either direction
+    if (zrle) {
+        uint64_t num_elem_zrle = ZRLE_MAX(MAX(num_elem_dev_inputs, num_elem_outputs) / batch_size * chunk_size);
+        zrle_buf = clCreateBuffer(
+                context, 
+                CL_MEM_READ_WRITE,
+                num_elem_zrle * sizeof(cnndata_t), 
+                NULL, 
+                &status); CHECK(status);
+        if ((zrle_host = (cnndata_t*)acl_aligned_malloc(num_elem_zrle * sizeof(cnndata_t))) == NULL) {
+            perror("Failed malloc of zero-RLE buffer");
+            exit(1);
+        }
+        host_tensor_bytes += num_elem_zrle * sizeof(cnndata_t);
+    }
+
     //----------------------------------------------
     // Create the program from binaries
     //----------------------------------------------
@@ -490,9 +1191,14 @@ bool init_opencl(FILE *f_out) {
     size_t binary_length;
     const unsigned char *binary;
 
-    printf("\nAOCX file: %s\n\n", AOCX_FILE);
+    std::string aocx_file = getBoardBinaryFile(aocx_prefix.c_str(), devices[0]);
+    if (selected_variant >= 0) {
+        printf("\nKernel variant: %s (%d fixed sizes) from %s\n", aocx_prefix.c_str(),
+               variants[selected_variant].num_fixed, variants_file.c_str());
+    }
+    printf("\nAOCX file: %s\n\n", aocx_file.c_str());
     // create the program using binary already compiled offline using aoc (i.e. the .aocx file)
-    FILE *fp = fopen(AOCX_FILE, "rb");
+    FILE *fp = fopen(aocx_file.c_str(), "rb");
 
     if (fp == NULL) {
         printf("Failed to open the AOCX file (fopen).\n");
@@ -551,94 +1257,538 @@ bool init_opencl(FILE *f_out) {
         kernel[j] = clCreateKernel(program, (const char*)kernel_name[j], &status);
         CHECK(status);
     }
+    if (zrle) {
+        zrle_kernel[0] = clCreateKernel(program, "cnn_unzrle", &status); CHECK(status);
+        zrle_kernel[1] = clCreateKernel(program, "cnn_zrle", &status); CHECK(status);
+    }
 
     return true;
 }
 
+// Converts ref_weights into the device weight layout (dt_weights).  With
+// -wcache= the packed tensor is looked up by content hash and mapped
+// straight from disk on a hit; a miss packs as usual and stores the
+// result for the next run.
+void pack_weights() {
+    uint64_t num_elem_ref_weights = layer_params.M_ofm * (layer_params.N_ifm / layer_params.groups) *
+                                    layer_params.K_wts * layer_params.K_wts;
+    char path[4096];
+    uint64_t hash = 0;
+    double t0;
+
+    // Compressed blocks, their size depends on the values
+    if (conv_engine == ENGINE_SPARSE) {
+        if ((dt_weights = (cnndata_t*)acl_aligned_malloc(num_elem_weights * sizeof(cnndata_t))) == NULL) {
+                perror("Failed malloc of weights matrix");
+                exit(1);
+        }
+        host_tensor_bytes += num_elem_weights * sizeof(cnndata_t);
+        t0 = getCurrentTimestamp();
+        num_elem_weights = wts_to_blocks(ref_weights, dt_weights, layer_params.M_ofm,
+                                         layer_params.N_ifm / layer_params.groups, layer_params.K_wts,
+                                         &sparse_blocks_kept);
+        transpose_time += getCurrentTimestamp() - t0;
+        return;
+    }
+
+    if (!wcache_dir.empty()) {
+        t0 = getCurrentTimestamp();
+        hash = hash_tensor(ref_weights, num_elem_ref_weights);
+        packed_weights_path(path, sizeof(path), wcache_dir.c_str(), hash, dev_params.M_ofm,
+                            dev_params.N_ifm / dev_params.groups, dev_params.K_wts);
+        wcache_time += getCurrentTimestamp() - t0;
+
+        if (map_packed_weights(path, num_elem_weights, &wcache_map)) {
+            dt_weights = wcache_map.data;
+            printf("Weights: packed cache hit %s\n", path);
+            return;
+        }
+    }
+
+    if ((dt_weights = (cnndata_t*)acl_aligned_malloc(num_elem_weights * sizeof(cnndata_t))) == NULL) {
+            perror("Failed malloc of weights matrix");
+            exit(1);
+    }
+    host_tensor_bytes += num_elem_weights * sizeof(cnndata_t);
+
+    t0 = getCurrentTimestamp();
+    if (phase_S > 1) {
+        uint64_t num_elem_phased = conv_params.M_ofm * (conv_params.N_ifm / conv_params.groups) *
+                                   conv_params.K_wts * conv_params.K_wts;
+        cnndata_t *phased = (cnndata_t*)acl_aligned_malloc(num_elem_phased * sizeof(cnndata_t));
+        if (phased == NULL) {
+            perror("Failed malloc of phased weights");
+            exit(1);
+        }
+        wts_to_phases(ref_weights, phased, layer_params.M_ofm, layer_params.N_ifm / layer_params.groups,
+                      layer_params.K_wts, phase_S);
+        wts_to_device(phased, dt_weights, conv_params.M_ofm, conv_params.N_ifm / conv_params.groups,
+                      conv_params.K_wts, dev_params.M_ofm, dev_params.N_ifm / dev_params.groups);
+        acl_aligned_free(phased);
+    } else {
+        wts_to_device(ref_weights, dt_weights, layer_params.M_ofm, layer_params.N_ifm / layer_params.groups,
+                      layer_params.K_wts, dev_params.M_ofm, dev_params.N_ifm / dev_params.groups);
+    }
+    transpose_time += getCurrentTimestamp() - t0;
+
+    if (!wcache_dir.empty()) {
+        t0 = getCurrentTimestamp();
+        if (store_packed_weights(path, dt_weights, num_elem_weights)) {
+            printf("Weights: packed cache miss, stored %s\n", path);
+        } else {
+            printf("Weights: could not store %s, running without the packed cache\n", path);
+        }
+        wcache_time += getCurrentTimestamp() - t0;
+    }
+}
+
 // Initialize the data for the problem
 void init_problem() {
     printf("\n===== Host-CPU preparing matrices ======\n\n");
 
     unsigned long row, col, to, ti, iter;
+    uint64_t num_elem_ref_input = layer_params.N_ifm * layer_params.R_ifm * layer_params.C_ifm;
+    uint64_t num_elem_ref_output = layer_params.M_ofm * layer_params.R_ofm * layer_params.C_ofm;
+    uint64_t num_elem_ref_weights = layer_params.M_ofm * (layer_params.N_ifm / layer_params.groups) *
+                                    layer_params.K_wts * layer_params.K_wts;
+    uint64_t num_elem_conv_input = conv_params.N_ifm * conv_params.R_ifm * conv_params.C_ifm;
+    double t0;
+
+    // Map the tensor files given on the command line
+    if (!input_file.empty() &&
+        !map_tensor_file(input_file.c_str(), batch_size * num_elem_ref_input, &input_map)) {
+        exit(1);
+    }
+    if (!weights_file.empty() && !map_tensor_file(weights_file.c_str(), num_elem_ref_weights, &weights_map)) {
+        exit(1);
+    }
+    if (!output_file.empty()) {
+        uint64_t shape[4] = { batch_size, layer_params.M_ofm, layer_params.R_ofm, layer_params.C_ofm };
+        if (!create_tensor_file(output_file.c_str(), shape, 4, &output_map)) {
+            exit(1);
+        }
+    }
 
     // Allocate memory for outputs
-    if ((dt_output = (cnndata_t*)acl_aligned_malloc(num_elem_outputs * sizeof(cnndata_t))) == NULL) {
-            perror("Failed malloc of output matrix");
-            exit(1);
+    if (act_dev_is_ref && output_map.data != NULL) {
+        // Read back straight into the output file, which starts zero-filled
+        dt_output = output_map.data;
+        printf("Output: %s (mapped, written in place)\n", output_file.c_str());
+    } else {
+        if ((dt_output = (cnndata_t*)acl_aligned_malloc(num_elem_outputs * sizeof(cnndata_t))) == NULL) {
+                perror("Failed malloc of output matrix");
+                exit(1);
+        }
+        host_tensor_bytes += num_elem_outputs * sizeof(cnndata_t);
+
+        // Set the actual output matrix to 0.
+        memset(dt_output, 0, num_elem_outputs * sizeof(cnndata_t));
     }
-    if ((ref_output = (cnndata_t*)acl_aligned_malloc(num_elem_outputs * sizeof(cnndata_t))) == NULL) {
+    // Reference output is recomputed per image during verification
+    if ((ref_output = (cnndata_t*)acl_aligned_malloc(num_elem_ref_output * sizeof(cnndata_t))) == NULL) {
             perror("Failed malloc of reference output matrix");
             exit(1);
     }
-
-    // Set the actual output and reference output matrices to 0.
-    for(iter=0;iter<batch_size;iter++) {
-        for(row = 0; row < layer_params.R_ofm; row++) {
-            for(col = 0; col < layer_params.C_ofm ; col++) {
-                for(to = 0; to < layer_params.M_ofm; to++) {
-                    ARRAYo(dt_output, iter, to, row, col, batch_size, layer_params.M_ofm,
-                           layer_params.R_ofm, layer_params.C_ofm) = 0;
-                    ARRAY4(ref_output, iter, to, row, col, batch_size, layer_params.M_ofm, 
-                           layer_params.R_ofm, layer_params.C_ofm) = 0;
+    host_tensor_bytes += num_elem_ref_output * sizeof(cnndata_t);
+    
+    // Allocate memory for inputs
+    if (act_dev_is_ref && is_dma_aligned(input_map.data)) {
+        // Hand the mapped file straight to clEnqueueWriteBuffer
+        dt_input = input_map.data;
+        printf("Input: %s (mapped, zero-copy)\n", input_file.c_str());
+    } else {
+        if ((dt_input = (cnndata_t*)acl_aligned_malloc(num_elem_inputs * sizeof(cnndata_t))) == NULL) {
+                perror("Failed malloc of input matrix");
+                exit(1);
+        }
+        host_tensor_bytes += num_elem_inputs * sizeof(cnndata_t);
+        if (!act_dev_is_ref && input_map.data == NULL) {
+            // One image worth of scratch, gathered from dt_input during verification
+            if ((ref_input = (cnndata_t*)acl_aligned_malloc(num_elem_ref_input * sizeof(cnndata_t))) == NULL) {
+                    perror("Failed malloc of input matrix");
+                    exit(1);
+            }
+            host_tensor_bytes += num_elem_ref_input * sizeof(cnndata_t);
+            if (phase_S > 1) {
+                if ((ph_input = (cnndata_t*)acl_aligned_malloc(num_elem_conv_input * sizeof(cnndata_t))) == NULL) {
+                        perror("Failed malloc of input matrix");
+                        exit(1);
                 }
+                host_tensor_bytes += num_elem_conv_input * sizeof(cnndata_t);
             }
         }
-    }
-    
-    // Allocate memory for inputs
-    if ((dt_input = (cnndata_t*)acl_aligned_malloc(num_elem_inputs * sizeof(cnndata_t))) == NULL) {
-            perror("Failed malloc of input matrix");
-            exit(1);
-    }
-    if ((ref_input = (cnndata_t*)acl_aligned_malloc(num_elem_inputs * sizeof(cnndata_t))) == NULL) {
-            perror("Failed malloc of input matrix");
-            exit(1);
-    }
 
-    // Generate the input matrix
-    for(iter=0;iter<batch_size;iter++) {
-        for(row = 0; row < layer_params.R_ifm; row++) {
-            for(col = 0; col < layer_params.C_ifm ; col++) {
-                for(ti = 0; ti < layer_params.N_ifm; ti++) {
-                    cnndata_t val=(((cnndata_t)(rand()%RANGE))/RANGE);
-                    ARRAY4(ref_input, iter, ti, row, col, batch_size, layer_params.N_ifm, layer_params.R_ifm, 
-                           layer_params.C_ifm) = val; 
-                    ARRAYi(dt_input, iter, ti, row, col, batch_size, layer_params.N_ifm, layer_params.R_ifm, 
-                           layer_params.C_ifm) = val;
+        if (input_map.data != NULL && phase_S > 1) {
+            // The whole batch goes through stride phases on its way over
+            cnndata_t *phased = (cnndata_t*)acl_aligned_malloc(batch_size * num_elem_conv_input * sizeof(cnndata_t));
+            if (phased == NULL) {
+                perror("Failed malloc of phased input");
+                exit(1);
+            }
+            printf("Input: %s (mapped, split into stride phases and copied into device layout)\n", input_file.c_str());
+            t0 = getCurrentTimestamp();
+            act_to_phases(input_map.data, phased, batch_size, layer_params.N_ifm, layer_params.R_ifm,
+                          layer_params.C_ifm, phase_S, conv_params.R_ifm, conv_params.C_ifm);
+            act_to_device(phased, dt_input, batch_size, conv_params.N_ifm, conv_params.R_ifm,
+                          conv_params.C_ifm, dev_params.N_ifm, dev_params.R_ifm, dev_params.C_ifm, TN);
+            transpose_time += getCurrentTimestamp() - t0;
+            acl_aligned_free(phased);
+        } else if (input_map.data != NULL) {
+            printf("Input: %s (mapped, copied into device layout)\n", input_file.c_str());
+            t0 = getCurrentTimestamp();
+            act_to_device(input_map.data, dt_input, batch_size, layer_params.N_ifm, layer_params.R_ifm,
+                          layer_params.C_ifm, dev_params.N_ifm, dev_params.R_ifm, dev_params.C_ifm, TN);
+            transpose_time += getCurrentTimestamp() - t0;
+        } else {
+            // Padding lanes of blocked layouts and tile padding are never generated
+            if (!act_dev_is_ref) {
+                memset(dt_input, 0, num_elem_inputs * sizeof(cnndata_t));
+            }
+
+            // Generate the input matrix (in place of its stride phase with -phases)
+            for(iter=0;iter<batch_size;iter++) {
+                for(row = 0; row < layer_params.R_ifm; row++) {
+                    for(col = 0; col < layer_params.C_ifm ; col++) {
+                        for(ti = 0; ti < layer_params.N_ifm; ti++) {
+                            cnndata_t val=(((cnndata_t)(rand()%RANGE))/RANGE);
+                            if (zeros_fraction > 0 && rand() % RANGE < zeros_fraction * RANGE) {
+                                val = 0;
+                            }
+                            ARRAYi(dt_input, iter, PHASE_D(ti, row, col, phase_S), PHASE_RC(row, phase_S),
+                                   PHASE_RC(col, phase_S), batch_size, dev_params.N_ifm, dev_params.R_ifm, 
+                                   dev_params.C_ifm) = val;
+                        }
+                    }
                 }
             }
         }
     }
     
     // Allocate memory for weights
-    if ((dt_weights = (cnndata_t*)acl_aligned_malloc(num_elem_weights * sizeof(cnndata_t))) == NULL) {
-            perror("Failed malloc of weights matrix");
-            exit(1);
-    }
-    if ((ref_weights = (cnndata_t*)acl_aligned_malloc(num_elem_weights * sizeof(cnndata_t))) == NULL) {
-            perror("Failed malloc of weights matrix");
-            exit(1);
-    }
+    if (wts_dev_is_ref && is_dma_aligned(weights_map.data)) {
+        dt_weights = weights_map.data;
+        ref_weights = dt_weights;
+        printf("Weights: %s (mapped, zero-copy)\n", weights_file.c_str());
+    } else {
+        if (wts_dev_is_ref) {
+            if ((dt_weights = (cnndata_t*)acl_aligned_malloc(num_elem_weights * sizeof(cnndata_t))) == NULL) {
+                    perror("Failed malloc of weights matrix");
+                    exit(1);
+            }
+            host_tensor_bytes += num_elem_weights * sizeof(cnndata_t);
+            ref_weights = dt_weights;
+        } else if (weights_map.data != NULL) {
+            ref_weights = weights_map.data;
+        } else {
+            if ((ref_weights = (cnndata_t*)acl_aligned_malloc(num_elem_ref_weights * sizeof(cnndata_t))) == NULL) {
+                    perror("Failed malloc of weights matrix");
+                    exit(1);
+            }
+            host_tensor_bytes += num_elem_ref_weights * sizeof(cnndata_t);
+        }
 
-    // Generate the weight matrix
-    for(to = 0; to < layer_params.M_ofm; to++) {
-        for(ti = 0; ti < layer_params.N_ifm; ti++) {
-            for(row = 0; row < layer_params.K_wts; row++) {
-                for(col=0; col < layer_params.K_wts; col++) {
-                    cnndata_t val=(((cnndata_t)(rand()%RANGE))/RANGE);
-                    ARRAY4(ref_weights, to, ti, row, col, layer_params.M_ofm, layer_params.N_ifm,
-                           layer_params.K_wts, layer_params.K_wts) = val; 
-                    ARRAYw(dt_weights, to, ti, row, col, layer_params.M_ofm, layer_params.N_ifm,
-                           layer_params.K_wts, layer_params.K_wts) = val; 
+        if (weights_map.data != NULL) {
+            printf("Weights: %s (mapped, copied into device layout)\n", weights_file.c_str());
+            if (wts_dev_is_ref) {
+                memcpy(dt_weights, weights_map.data, num_elem_weights * sizeof(cnndata_t));
+            }
+        } else {
+            // Generate the weight matrix in the reference layout
+            for(to = 0; to < layer_params.M_ofm; to++) {
+                for(ti = 0; ti < layer_params.N_ifm / layer_params.groups; ti++) {
+                    for(row = 0; row < layer_params.K_wts; row++) {
+                        for(col=0; col < layer_params.K_wts; col++) {
+                            cnndata_t val=(((cnndata_t)(rand()%RANGE))/RANGE);
+                            ARRAY4(ref_weights, to, ti, row, col, layer_params.M_ofm, layer_params.N_ifm / layer_params.groups,
+                                   layer_params.K_wts, layer_params.K_wts) = val; 
+                        }
+                    }
+                }
+            }
+
+            // Zero whole SP_BN-channel blocks, see -prune
+            if (prune_fraction > 0) {
+                uint64_t Ng = layer_params.N_ifm / layer_params.groups;
+                uint64_t KK = layer_params.K_wts * layer_params.K_wts;
+                for(to = 0; to < layer_params.M_ofm; to++) {
+                    for(ti = 0; ti < Ng; ti += SP_BN) {
+                        if (rand() % RANGE < prune_fraction * RANGE) {
+                            memset(&ref_weights[(to * Ng + ti) * KK], 0, MIN((uint64_t)SP_BN, Ng - ti) * KK * sizeof(cnndata_t));
+                        }
+                    }
                 }
             }
         }
+
+        // cnn_gemm reads ref_weights as they are
+        if (!wts_dev_is_ref && conv_engine != ENGINE_GEMM) {
+            pack_weights();
+        }
+    }
+
+    if (conv_engine == ENGINE_GEMM) {
+        uint64_t num_elem_chunk = num_elem_dev_inputs / batch_size * chunk_size;
+        if ((dt_im2col = (cnndata_t*)acl_aligned_malloc(num_elem_chunk * sizeof(cnndata_t))) == NULL) {
+                perror("Failed malloc of im2col matrix");
+                exit(1);
+        }
+        host_tensor_bytes += num_elem_chunk * sizeof(cnndata_t);
+    }
+
+    printf("Host tensor memory: %.2f MB (%s)\n", host_tensor_bytes / 1.0e6,
+           act_dev_is_ref ? "reference shares device layout" : "reference gathered per image");
+}
+
+// Returns image iter of the input batch in the reference (ARRAY4) layout.
+// Reads dt_input (or the input file) in place when possible, otherwise
+// gathers the image into the ref_input scratch.
+cnndata_t* ref_input_image(uint64_t iter) {
+    if (act_dev_is_ref || input_map.data != NULL) {
+        return &ARRAY4(act_dev_is_ref ? dt_input : input_map.data, iter, 0, 0, 0, batch_size,
+                       layer_params.N_ifm, layer_params.R_ifm, layer_params.C_ifm);
+    }
+
+    double t0 = getCurrentTimestamp();
+    act_from_device(&ARRAYi(dt_input, iter, 0, 0, 0, batch_size, dev_params.N_ifm, dev_params.R_ifm,
+                            dev_params.C_ifm),
+                    phase_S > 1 ? ph_input : ref_input, 1, conv_params.N_ifm, conv_params.R_ifm,
+                    conv_params.C_ifm, dev_params.N_ifm, dev_params.R_ifm, dev_params.C_ifm, TN);
+    if (phase_S > 1) {
+        act_from_phases(ph_input, ref_input, 1, layer_params.N_ifm, layer_params.R_ifm, layer_params.C_ifm,
+                        phase_S, conv_params.R_ifm, conv_params.C_ifm);
+    }
+    transpose_time += getCurrentTimestamp() - t0;
+    return ref_input;
+}
+
+// Store dt_output into the -output file unless it was read back in place
+void write_output() {
+    if (output_map.data == NULL || dt_output == output_map.data) {
+        return;
+    }
+
+    double t0 = getCurrentTimestamp();
+    act_from_device(dt_output, output_map.data, batch_size, layer_params.M_ofm, layer_params.R_ofm,
+                    layer_params.C_ofm, dev_params.M_ofm, dev_params.R_ofm, dev_params.C_ofm, TM);
+    printf("Output: wrote %s (transpose %.5f s)\n", output_file.c_str(), getCurrentTimestamp() - t0);
+}
+
+// Write n elements of src into the device window win: packed on the
+// host, unpacked into win by cnn_unzrle
+void zrle_write(cl_mem win, const cnndata_t *src, uint64_t n) {
+    cl_int status;
+    cl_event event;
+    double t0, start_d, end_d;
+
+    t0 = getCurrentTimestamp();
+    uint64_t words = zrle_encode(src, n, zrle_host);
+    zrle_host_time += getCurrentTimestamp() - t0;
+
+    t0 = getCurrentTimestamp();
+    status = clEnqueueWriteBuffer(cmdQueue[0], zrle_buf, CL_TRUE, 0, words * sizeof(cnndata_t), zrle_host,
+                                  0, NULL, NULL); CHECK(status);
+    zrle_pcie_time += getCurrentTimestamp() - t0;
+    zrle_dense_bytes[0] += n * sizeof(cnndata_t);
+    zrle_packed_bytes[0] += words * sizeof(cnndata_t);
+
+    status = clSetKernelArg(zrle_kernel[0], 0, sizeof(cl_mem), (void*)&zrle_buf); CHECK(status);
+    status = clSetKernelArg(zrle_kernel[0], 1, sizeof(cl_mem), (void*)&win); CHECK(status);
+    status = clSetKernelArg(zrle_kernel[0], 2, sizeof(uint64_t), (void*)&n); CHECK(status);
+    status = clEnqueueTask(cmdQueue[0], zrle_kernel[0], 0, NULL, &event); CHECK(status);
+    status = clFinish(cmdQueue[0]); CHECK(status);
+    zrle_device_time += compute_kernel_execution_time(event, start_d, end_d);
+    clReleaseEvent(event);
+}
+
+// Read n elements of the device window win into dst: packed by
+// cnn_zrle, then the count and masks are read back ahead of the values
+void zrle_read(cl_mem win, cnndata_t *dst, uint64_t n) {
+    cl_int status;
+    cl_event event;
+    double t0, start_d, end_d;
+
+    status = clSetKernelArg(zrle_kernel[1], 0, sizeof(cl_mem), (void*)&win); CHECK(status);
+    status = clSetKernelArg(zrle_kernel[1], 1, sizeof(cl_mem), (void*)&zrle_buf); CHECK(status);
+    status = clSetKernelArg(zrle_kernel[1], 2, sizeof(uint64_t), (void*)&n); CHECK(status);
+    status = clEnqueueTask(cmdQueue[0], zrle_kernel[1], 0, NULL, &event); CHECK(status);
+    status = clFinish(cmdQueue[0]); CHECK(status);
+    zrle_device_time += compute_kernel_execution_time(event, start_d, end_d);
+    clReleaseEvent(event);
+
+    t0 = getCurrentTimestamp();
+    status = clEnqueueReadBuffer(cmdQueue[0], zrle_buf, CL_TRUE, 0, ZRLE_HEADER(n) * sizeof(cnndata_t),
+                                 zrle_host, 0, NULL, NULL); CHECK(status);
+    uint64_t nnz = ((unsigned*)zrle_host)[0];
+    if (nnz > 0) {
+        status = clEnqueueReadBuffer(cmdQueue[0], zrle_buf, CL_TRUE, ZRLE_HEADER(n) * sizeof(cnndata_t),
+                                     nnz * sizeof(cnndata_t), zrle_host + ZRLE_HEADER(n), 0, NULL, NULL);
+        CHECK(status);
     }
+    zrle_pcie_time += getCurrentTimestamp() - t0;
+    zrle_dense_bytes[1] += n * sizeof(cnndata_t);
+    zrle_packed_bytes[1] += (ZRLE_HEADER(n) + nnz) * sizeof(cnndata_t);
+
+    t0 = getCurrentTimestamp();
+    zrle_decode(zrle_host, n, dst);
+    zrle_host_time += getCurrentTimestamp() - t0;
+}
+
+// Waits until the persistent kernel has done its first n jobs, returns
+// when that was seen.  Transfers use the extra queue, as cmdQueue[0]
+// holds the resident kernel.
+double wait_jobs(uint64_t n) {
+    cl_int status;
+    uint64_t ring[2] = { 0, 0 };
+
+    while (ring[1] < n) {
+        status = clEnqueueReadBuffer(cmdQueue[NUM_QUEUES_TO_CREATE], ring_buf, CL_TRUE, 0, sizeof(ring), ring,
+                                     0, NULL, NULL); CHECK(status);
+    }
+    return getCurrentTimestamp();
+}
+
+// Posts job to the persistent kernel without waiting for it, returns
+// when the doorbell moved.  The descriptor is in its ring slot before
+// the doorbell moves, and a slot is reused once its job, JOBQ back, is
+// done.  A stop job ends the kernel.
+double post_job(const cnn_job *job) {
+    cl_int status;
+
+    if (job->batch_size > 0) {
+        check_job_layer(&job->layer);
+    }
+
+    if (jobs_posted >= JOBQ) {
+        wait_jobs(jobs_posted - JOBQ + 1);
+    }
+    status = clEnqueueWriteBuffer(cmdQueue[NUM_QUEUES_TO_CREATE], job_buf, CL_TRUE,
+                                  (jobs_posted % JOBQ) * sizeof(cnn_job), sizeof(cnn_job), job, 0, NULL, NULL);
+    CHECK(status);
+    jobs_posted++;
+
+    double t0 = getCurrentTimestamp();
+    status = clEnqueueWriteBuffer(cmdQueue[NUM_QUEUES_TO_CREATE], ring_buf, CL_TRUE, 0, sizeof(uint64_t),
+                                  &jobs_posted, 0, NULL, NULL); CHECK(status);
+    return t0;
+}
+
+// A chunk posted to the persistent kernel, read back once its job is done
+typedef struct {
+    uint64_t job;       // jobs posted up to and including this one, 0 = none
+    unsigned slot;      // chunk slot of input_buf and output_buf
+    double posted;      // doorbell time
+    size_t offset;      // its output in output_buf, bytes
+    size_t bytes;
+    cnndata_t *output;  // where the output goes in dt_output
+} posted_chunk;
+
+// Waits for the job of chunk and reads its output back (blocking).
+// Returns the kernel time of the job, from its doorbell or the previous
+// job done, whichever came later.
+double drain_chunk(posted_chunk *chunk, double *last_done) {
+    cl_int status;
+    double done = wait_jobs(chunk->job);
+    double t = done - MAX(chunk->posted, *last_done);
+
+    *last_done = done;
+    status = clEnqueueReadBuffer(cmdQueue[NUM_QUEUES_TO_CREATE], output_buf, CL_TRUE, chunk->offset, chunk->bytes,
+                                 chunk->output, 0, NULL, NULL); CHECK(status);
+    chunk->job = 0;
+    return t;
+}
+
+// True if the loaded kernel runs the device-geometry layer as given.
+// cnn_unit takes every size the kernel was built with (FIX_* in
+// kernel643.h, or the fixed sizes of the variant) over the layer's.
+bool layer_fits_kernel(const layer_size *layer) {
+    if (selected_variant >= 0) {
+        const layer_size *v = &variants[selected_variant].layer;
+#define FITS(fixed, tile, size) ((fixed) == 0 || (EXACT_TILES ? ROUND_UP(fixed, tile) : (fixed)) == (size))
+        return FITS(v->K_wts, 1, layer->K_wts) && FITS(v->S_wts, 1, layer->S_wts) &&
+               FITS(v->R_ofm, kernel_params.Tr, layer->R_ofm) && FITS(v->C_ofm, kernel_params.Tc, layer->C_ofm) &&
+               FITS(v->M_ofm, kernel_params.Tm, layer->M_ofm) && FITS(v->N_ifm, kernel_params.Tn, layer->N_ifm) &&
+               FITS(v->groups, 1, layer->groups);
+#undef FITS
+    }
+    return (!FIX_K || layer->K_wts == K_WTS) && (!FIX_S || layer->S_wts == S_WTS) &&
+           (!FIX_R || layer->R_ofm == DEV_R_OFM) && (!FIX_C || layer->C_ofm == DEV_C_OFM) &&
+           (!FIX_M || layer->M_ofm == DEV_M_OFM) && (!FIX_N || layer->N_ifm == DEV_N_IFM) &&
+           (!FIX_G || layer->groups == G_GRP) &&
+           (!FIX_P || (layer->pad_top == P_TOP && layer->pad_left == P_LEFT));
+}
+
+// Jobs may differ in every layer size the kernel reads at run time,
+// a job of another fixed size would silently run as the fixed one
+void check_job_layer(const layer_size *layer) {
+    if (!layer_fits_kernel(layer)) {
+        printf("ERROR: job layer k=%lu s=%lu rofm=%lu cofm=%lu mofm=%lu nifm=%lu groups=%lu differs from "
+               "the sizes the kernel was built with, use a build with those sizes not fixed (FIX_*=0)\n",
+               layer->K_wts, layer->S_wts, layer->R_ofm, layer->C_ofm, layer->M_ofm, layer->N_ifm,
+               layer->groups);
+        exit(1);
+    }
+}
+
+// Adds a job to the table of the next launch_jobs()
+void submit_job(uint64_t input_offset, uint64_t output_offset, uint64_t weight_offset, uint64_t batch,
+                const layer_size *layer) {
+    check_job_layer(layer);
+    cnn_job job = { input_offset, output_offset, weight_offset, batch, *layer };
+    job_table.push_back(job);
+}
+
+// Runs the submitted jobs with one cnn_jobs launch on the buffers
+// already set as arguments 0 to 2 and returns the kernel time.  The
+// rest of the enqueue to clFinish time is the launch overhead the jobs
+// share.
+double launch_jobs() {
+    cl_int status;
+    uint64_t num_jobs = job_table.size();
+    double start_d, end_d;
+
+    status = clEnqueueWriteBuffer(cmdQueue[0], job_table_buf, CL_TRUE, 0, num_jobs * sizeof(cnn_job),
+                                  job_table.data(), 0, NULL, NULL); CHECK(status);
+    status = clSetKernelArg(kernel[0], 3, sizeof(uint64_t), (void*)&num_jobs); CHECK(status);
+    status = clSetKernelArg(kernel[0], 5, sizeof(cl_mem), (void*)&job_table_buf); CHECK(status);
+
+    double t0 = getCurrentTimestamp();
+    status = clEnqueueTask(cmdQueue[0], kernel[0], 0, NULL, &kernel_exec_event[0]); CHECK(status);
+    status = clFinish(cmdQueue[0]); CHECK(status);
+    double wall = getCurrentTimestamp() - t0;
+
+    double exec = compute_kernel_execution_time(kernel_exec_event[0], start_d, end_d);
+    clReleaseEvent(kernel_exec_event[0]);
+    job_launch_overhead += MAX(wall - exec, 0.0);
+    jobs_launched += num_jobs;
+    job_launches++;
+    job_table.clear();
+    return exec;
+}
+
+// Share of a chunk on the CPU engine, run next to the device
+typedef struct cpu_task {
+    const cnndata_t *input;
+    cnndata_t *output;
+    uint64_t batch;
+    layer_size layer;
+    double time;
+} cpu_task;
+
+static void* cpu_worker(void *arg) {
+    cpu_task *task = (cpu_task*)arg;
+    double t0 = getCurrentTimestamp();
+    cpu_conv(task->input, dt_weights, task->output, task->batch, &task->layer);
+    task->time = getCurrentTimestamp() - t0;
+    return NULL;
 }
 
 void run() {
     cl_int status;
     unsigned int i;
+    uint64_t b0;
+
+    const uint64_t num_elem_input_image  = num_elem_dev_inputs / batch_size;
+    const uint64_t num_elem_output_image = num_elem_outputs / batch_size;
 
     printf("\n===== Host-CPU transferring matrices A,B to the FPGA device global memory (DDR4) via PCIe ======\n\n");
 
@@ -646,75 +1796,71 @@ void run() {
     // Write host data to device buffers
     //----------------------------------------------
 
-    // blocking writes
-    status = clEnqueueWriteBuffer(
-            cmdQueue[0],
-            input_buf,
-            CL_TRUE,
-            0,
-            num_elem_inputs * sizeof(cnndata_t),
-            dt_input,
-            0,
-            NULL,
-            NULL); CHECK(status);
-
-    status = clEnqueueWriteBuffer(
-            cmdQueue[0],
-            weight_buf,
-            CL_TRUE,
-            0,
-            num_elem_weights * sizeof(cnndata_t),
-            dt_weights,
-            0,
-            NULL,
-            NULL); CHECK(status);
-
-    status = clEnqueueWriteBuffer(
-            cmdQueue[0],
-            output_buf,
-            CL_TRUE,
-            0,
-            num_elem_outputs * sizeof(cnndata_t),
-            dt_output,
-            0,
-            NULL,
-            NULL); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        0,
-        sizeof(cl_mem),
-        (void*)&input_buf); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        1,
-        sizeof(cl_mem),
-        (void*)&weight_buf); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        2,
-        sizeof(cl_mem),
-        (void*)&output_buf); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        3,
-        sizeof(uint64_t),
-        (void*)&batch_size); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        4,
-        sizeof(kernel_size),
-        (void*)&kernel_params); CHECK(status);
-
-    status = clSetKernelArg(
-        kernel[0],
-        5,
-        sizeof(layer_size),
-        (void*)&layer_params); CHECK(status);
+    // Weights are shared by every chunk, write them once (blocking)
+    const cnndata_t *kernel_weights = conv_engine == ENGINE_GEMM ? ref_weights : dt_weights;
+    if (!native_backend) {
+        status = clEnqueueWriteBuffer(
+                cmdQueue[0],
+                weight_buf,
+                CL_TRUE,
+                0,
+                (conv_engine == ENGINE_GEMM ? layer_params.M_ofm * layer_params.N_ifm * layer_params.K_wts *
+                 layer_params.K_wts : num_elem_weights) * sizeof(cnndata_t),
+                kernel_weights,
+                0,
+                NULL,
+                NULL); CHECK(status);
+    }
+
+    // Compute unit i runs output channels [m_first, m_end) of the whole
+    // weight tensor, b_first is set per chunk
+    layer_size unit_params[NUM_KERNELS];
+    for (i = 0; i < num_units; i++) {
+        unit_params[i] = dev_params;
+        unit_params[i].m_first = m_partition ? i * unit_channels : 0;
+        unit_params[i].m_end = m_partition ? MIN((i + 1) * unit_channels, dev_params.M_ofm) : dev_params.M_ofm;
+
+        if (native_backend) {
+            continue; // native_launch takes unit_params directly
+        }
+
+        status = clSetKernelArg(
+            kernel[i],
+            1,
+            sizeof(cl_mem),
+            (void*)&weight_buf); CHECK(status);
+
+        status = clSetKernelArg(
+            kernel[i],
+            4,
+            sizeof(kernel_size),
+            (void*)&kernel_params); CHECK(status);
+
+        if (!persistent && job_images == 0) {
+            status = clSetKernelArg(
+                kernel[i],
+                5,
+                sizeof(layer_size),
+                (void*)&unit_params[i]); CHECK(status);
+        }
+    }
+
+    // The persistent kernel stays on cmdQueue[0] until the stop job,
+    // the chunk transfers go through the extra queue meanwhile
+    cl_command_queue xfer_queue = cmdQueue[persistent ? NUM_QUEUES_TO_CREATE : 0];
+    if (persistent) {
+        uint64_t ring[2] = { 0, 0 };
+        status = clEnqueueWriteBuffer(xfer_queue, ring_buf, CL_TRUE, 0, sizeof(ring), ring, 0, NULL, NULL);
+        CHECK(status);
+
+        status = clSetKernelArg(kernel[0], 0, sizeof(cl_mem), (void*)&input_buf); CHECK(status);
+        status = clSetKernelArg(kernel[0], 2, sizeof(cl_mem), (void*)&output_buf); CHECK(status);
+        status = clSetKernelArg(kernel[0], 3, sizeof(cl_mem), (void*)&job_buf); CHECK(status);
+        status = clSetKernelArg(kernel[0], 5, sizeof(cl_mem), (void*)&ring_buf); CHECK(status);
+
+        status = clEnqueueTask(cmdQueue[0], kernel[0], 0, NULL, &kernel_exec_event[0]); CHECK(status);
+        status = clFlush(cmdQueue[0]); CHECK(status);
+    }
 
     const double start_time = getCurrentTimestamp();
 
@@ -725,64 +1871,394 @@ void run() {
     const size_t global_work_size[3] = { 1, 1, 1 };
     const size_t local_work_size[3] = { 1, 1, 1 };
 
+    double k_start_time[NUM_QUEUES_TO_FINISH];
+    double k_end_time[NUM_QUEUES_TO_FINISH];
+    double k_exec_time[NUM_QUEUES_TO_FINISH];
+    uint64_t k_images[NUM_QUEUES_TO_FINISH];
+    double k_overall_exec_time = 0;
+    uint64_t weight_passes = 0; // times the kernels stream the whole weight tensor
+
+    for (i = 0; i < NUM_QUEUES_TO_FINISH; i++) {
+        k_start_time[i] = k_end_time[i] = k_exec_time[i] = 0;
+        k_images[i] = 0;
+    }
+
     //----------------------------------------------
-    // Enqueue the kernel for execution
+    // Stream the batch through the device one chunk at a time.  Each
+    // chunk runs in a sub-buffer window at the start of input_buf and
+    // output_buf, and its output is read back in place into dt_output.
+    // The compute units split the images of the chunk as evenly as they
+    // go, each from its b_first in the window, or all run every image
+    // under m_partition.
+    //
+    // -persistent posts each chunk as a job on input_buf and output_buf
+    // at the offset of its slot, and reads chunk c back only after chunk
+    // c+1 is uploaded and posted, so the uploads overlap the kernel.
+    // With one slot, or -cpu measuring the device time of each chunk,
+    // the jobs run one at a time.
     //----------------------------------------------
 
-    printf("\n===== Host-CPU enqeuing the OpenCL kernels to the FPGA device ======\n\n");
-    const double start_time1 = getCurrentTimestamp();
+    // Output image the CPU engine fills in channel splits
+    cnndata_t *cpu_scratch = NULL;
+    if (cpu_share > 0) {
+        uint64_t n = SIZEo(1, dev_params.M_ofm, dev_params.R_ofm, dev_params.C_ofm);
+        if ((cpu_scratch = (cnndata_t*)acl_aligned_malloc(n * sizeof(cnndata_t))) == NULL) {
+            perror("Failed malloc of CPU output image");
+            exit(1);
+        }
+    }
 
-    for(i = 0; i < NUM_KERNELS_TO_CREATE; i++) {
-        // Alternatively, can use clEnqueueTaskKernel
-        // printf("clEnqueueNDRangeKernel[%d]: %s!\n", i, kernel_name[i]);
-        status = clEnqueueNDRangeKernel(
-                        cmdQueue[i],
-                        kernel[i],
-                        3,
-                        NULL,
-                        global_work_size,
-                        local_work_size,
+    posted_chunk pending = { 0, 0, 0, 0, 0, NULL };
+    double last_done = 0;
+
+    for (b0 = 0; b0 < batch_size; b0 += chunk_size) {
+        uint64_t chunk_batch = MIN(chunk_size, batch_size - b0);
+
+        // Co-execution: the CPU engine takes the last cpu_batch images of
+        // the chunk, or output channels [m_split, M_ofm) of a single image,
+        // while the device runs the rest.  Each side keeps at least an
+        // image or a Tm block of channels, so -cpu_adapt keeps measuring
+        // both rates instead of rounding the CPU out for good.
+        uint64_t cpu_batch = 0, m_split = dev_params.M_ofm;
+        if (cpu_share > 0 && chunk_batch > 1) {
+            cpu_batch = MIN(MAX((uint64_t)(chunk_batch * cpu_share + 0.5), 1), chunk_batch - 1);
+        } else if (cpu_share > 0 && num_units == 1 && !persistent && job_images == 0 &&
+                   dev_params.M_ofm > kernel_params.Tm) {
+            m_split = ROUND_UP((uint64_t)(dev_params.M_ofm * (1 - cpu_share)), kernel_params.Tm);
+            m_split = MIN(MAX(m_split, kernel_params.Tm),
+                          (dev_params.M_ofm - 1) / kernel_params.Tm * kernel_params.Tm);
+        }
+        chunk_batch -= cpu_batch;
+
+        pthread_t cpu_thread;
+        cpu_task task;
+        bool cpu_run = cpu_batch > 0 || m_split < dev_params.M_ofm;
+        if (cpu_run) {
+            task.layer = dev_params;
+            task.layer.m_first = m_split < dev_params.M_ofm ? m_split : 0;
+            task.layer.m_end = dev_params.M_ofm;
+            task.batch = m_split < dev_params.M_ofm ? 1 : cpu_batch;
+            task.input = &ARRAYi(dt_input, b0 + chunk_batch - (m_split < dev_params.M_ofm), 0, 0, 0, batch_size,
+                                 dev_params.N_ifm, dev_params.R_ifm, dev_params.C_ifm);
+            task.output = &ARRAYo(dt_output, b0 + chunk_batch, 0, 0, 0, batch_size, dev_params.M_ofm,
+                                  dev_params.R_ofm, dev_params.C_ofm);
+            if (m_split < dev_params.M_ofm) {
+                task.output = cpu_scratch;
+                memset(cpu_scratch, 0, SIZEo(1, dev_params.M_ofm, dev_params.R_ofm, dev_params.C_ofm) *
+                       sizeof(cnndata_t));
+                unit_params[0].m_end = m_split;
+                if (!native_backend) {
+                    status = clSetKernelArg(kernel[0], 5, sizeof(layer_size), (void*)&unit_params[0]);
+                    CHECK(status);
+                }
+            }
+            if (pthread_create(&cpu_thread, NULL, cpu_worker, &task) != 0) {
+                printf("ERROR: failed to start the CPU engine thread\n");
+                exit(1);
+            }
+        }
+        double dev_start = getCurrentTimestamp();
+
+        unsigned chunk_units = m_partition ? num_units : MIN(num_units, chunk_batch);
+        cl_buffer_region input_region  = { 0, chunk_batch * num_elem_input_image * sizeof(cnndata_t) };
+        cl_buffer_region output_region = { 0, chunk_batch * num_elem_output_image * sizeof(cnndata_t) };
+
+        // The slot of a persistent chunk, free once its last job is read back
+        unsigned slot = b0 / chunk_size % chunk_slots;
+        size_t input_offset = slot * chunk_size * num_elem_input_image * sizeof(cnndata_t);
+        size_t output_offset = slot * chunk_size * num_elem_output_image * sizeof(cnndata_t);
+        if (pending.job > 0 && pending.slot == slot) {
+            k_overall_exec_time += drain_chunk(&pending, &last_done);
+        }
+
+        cl_mem input_win = NULL, output_win = NULL;
+        if (!native_backend && !persistent) {
+            input_win = clCreateSubBuffer(
+                    input_buf,
+                    zrle ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY,
+                    CL_BUFFER_CREATE_TYPE_REGION,
+                    &input_region,
+                    &status); CHECK(status);
+
+            output_win = clCreateSubBuffer(
+                    output_buf,
+                    zrle ? CL_MEM_READ_WRITE : CL_MEM_WRITE_ONLY,
+                    CL_BUFFER_CREATE_TYPE_REGION,
+                    &output_region,
+                    &status); CHECK(status);
+        }
+
+        if (conv_engine == ENGINE_GEMM) {
+            uint64_t iter;
+            double t0 = getCurrentTimestamp();
+            for (iter = b0; iter < b0 + chunk_batch; iter++) {
+                im2col(ref_input_image(iter), &dt_im2col[(iter - b0) * num_elem_input_image], 1,
+                       layer_params.N_ifm, layer_params.R_ifm, layer_params.C_ifm, layer_params.K_wts,
+                       layer_params.S_wts, layer_params.R_ofm, layer_params.C_ofm, layer_params.pad_top,
+                       layer_params.pad_left);
+            }
+            im2col_time += getCurrentTimestamp() - t0;
+        }
+
+        const cnndata_t *chunk_input = conv_engine == ENGINE_GEMM ? dt_im2col :
+                &ARRAYi(dt_input, b0, 0, 0, 0, batch_size, dev_params.N_ifm, dev_params.R_ifm,
+                        dev_params.C_ifm);
+        cnndata_t *chunk_output = &ARRAYo(dt_output, b0, 0, 0, 0, batch_size, dev_params.M_ofm,
+                                          dev_params.R_ofm, dev_params.C_ofm);
+
+        // blocking writes, the native kernels work on the host tensors in place
+        if (zrle) {
+            zrle_write(input_win, chunk_input, input_region.size / sizeof(cnndata_t));
+            zrle_write(output_win, chunk_output, output_region.size / sizeof(cnndata_t));
+        } else if (!native_backend) {
+            status = clEnqueueWriteBuffer(
+                    xfer_queue,
+                    persistent ? input_buf : input_win,
+                    CL_TRUE,
+                    input_offset,
+                    input_region.size,
+                    chunk_input,
+                    0,
+                    NULL,
+                    NULL); CHECK(status);
+
+            status = clEnqueueWriteBuffer(
+                    xfer_queue,
+                    persistent ? output_buf : output_win,
+                    CL_TRUE,
+                    output_offset,
+                    output_region.size,
+                    chunk_output,
+                    0,
+                    NULL,
+                    NULL); CHECK(status);
+        }
+
+        if (native_backend) {
+            weight_passes += conv_engine == ENGINE_POINTWISE ?
+                CEIL_DIV(chunk_batch * dev_params.R_ofm * dev_params.C_ofm, PW_BQ) :
+                CEIL_DIV(chunk_batch, kernel_params.Tb);
+
+            printf("\n===== Host-CPU running the native kernels (images %lu-%lu) ======\n\n",
+                   b0, b0 + chunk_batch - 1);
+            double t0 = getCurrentTimestamp();
+            native_launch(conv_engine, chunk_input, kernel_weights, chunk_output, chunk_batch,
+                          num_elem_input_image, num_elem_output_image, &kernel_params, &unit_params[0]);
+            double t1 = getCurrentTimestamp();
+
+            k_exec_time[0] += t1 - t0;
+            k_images[0] += chunk_batch;
+            if (b0 == 0) {
+                k_start_time[0] = t0 - start_time;
+            }
+            k_end_time[0] = t1 - start_time;
+            k_overall_exec_time += t1 - t0;
+        } else if (persistent) {
+            cnn_job job = { input_offset / sizeof(cnndata_t), output_offset / sizeof(cnndata_t), 0, chunk_batch,
+                            unit_params[0] };
+            weight_passes += CEIL_DIV(chunk_batch, kernel_params.Tb);
+
+            printf("\n===== Host-CPU posting job %lu to the persistent kernel (images %lu-%lu) ======\n\n",
+                   jobs_posted, b0, b0 + chunk_batch - 1);
+            posted_chunk chunk = { 0, slot, post_job(&job), output_offset, output_region.size, chunk_output };
+            chunk.job = jobs_posted;
+
+            // The previous chunk ran while this one uploaded
+            if (pending.job > 0) {
+                k_overall_exec_time += drain_chunk(&pending, &last_done);
+            }
+            pending = chunk;
+            if (cpu_run) {
+                k_overall_exec_time += drain_chunk(&pending, &last_done);
+            }
+        } else if (job_images > 0) {
+            // One job per job_images images of the chunk, all in one launch
+            uint64_t j0;
+            for (j0 = 0; j0 < chunk_batch; j0 += job_images) {
+                uint64_t job_batch = MIN(job_images, chunk_batch - j0);
+                submit_job(j0 * num_elem_input_image, j0 * num_elem_output_image, 0, job_batch, &unit_params[0]);
+                weight_passes += CEIL_DIV(job_batch, kernel_params.Tb);
+            }
+
+            status = clSetKernelArg(kernel[0], 0, sizeof(cl_mem), (void*)&input_win); CHECK(status);
+            status = clSetKernelArg(kernel[0], 2, sizeof(cl_mem), (void*)&output_win); CHECK(status);
+
+            printf("\n===== Host-CPU launching %lu jobs on the FPGA device (images %lu-%lu) ======\n\n",
+                   (uint64_t)job_table.size(), b0, b0 + chunk_batch - 1);
+            k_overall_exec_time += launch_jobs();
+        } else {
+            uint64_t unit_batch[NUM_KERNELS];
+            for (i = 0; i < chunk_units; i++) {
+                // the first chunk_batch % chunk_units units take an extra image
+                uint64_t share = chunk_batch / chunk_units, extra = chunk_batch % chunk_units;
+                unit_params[i].b_first = m_partition ? 0 : i * share + MIN(i, extra);
+                unit_batch[i] = m_partition ? chunk_batch : share + (i < extra);
+                if (!m_partition || i == 0) {
+                    // the channel ranges stream the weights once between them
+                    weight_passes += conv_engine == ENGINE_POINTWISE ?
+                        CEIL_DIV(unit_batch[i] * dev_params.R_ofm * dev_params.C_ofm, PW_BQ) :
+                        CEIL_DIV(unit_batch[i], kernel_params.Tb);
+                }
+
+                // The units share the chunk buffers and write disjoint parts
+                // of them: their channels [m_first, m_end) of every image
+                // under m_partition, or else their images from b_first.
+                // Writes through overlapping sub-buffers are undefined in
+                // OpenCL, and sub-buffers per unit would need aligned offsets.
+                status = clSetKernelArg(
+                    kernel[i],
+                    0,
+                    sizeof(cl_mem),
+                    (void*)&input_win); CHECK(status);
+
+                status = clSetKernelArg(
+                    kernel[i],
+                    2,
+                    sizeof(cl_mem),
+                    (void*)&output_win); CHECK(status);
+
+                status = clSetKernelArg(
+                    kernel[i],
+                    5,
+                    sizeof(layer_size),
+                    (void*)&unit_params[i]); CHECK(status);
+
+                status = clSetKernelArg(
+                    kernel[i],
+                    3,
+                    sizeof(uint64_t),
+                    (void*)&unit_batch[i]); CHECK(status);
+            }
+
+            //----------------------------------------------
+            // Enqueue the kernel for execution
+            //----------------------------------------------
+
+            printf("\n===== Host-CPU enqeuing the OpenCL kernels to the FPGA device (images %lu-%lu) ======\n\n",
+                   b0, b0 + chunk_batch - 1);
+
+            for(i = 0; i < chunk_units; i++) {
+                // Alternatively, can use clEnqueueTaskKernel
+                // printf("clEnqueueNDRangeKernel[%d]: %s!\n", i, kernel_name[i]);
+                status = clEnqueueNDRangeKernel(
+                                cmdQueue[i],
+                                kernel[i],
+                                3,
+                                NULL,
+                                global_work_size,
+                                local_work_size,
+                                0,
+                                NULL,
+                                &kernel_exec_event[i]
+                                );
+                CHECK(status);
+            }
+            // printf(" *** FPGA execution started!\n");
+
+            for(i = 0; i < chunk_units; i++) {
+                status = clFlush(cmdQueue[i]);
+                CHECK(status);
+            }
+
+            for(i = 0; i < chunk_units; i++) {
+                status = clFinish(cmdQueue[i]); CHECK(status);
+            }
+
+            printf(" *** FPGA execution finished!\n");
+
+            double chunk_start_time = 0, chunk_end_time = 0;
+            for (i = 0; i < chunk_units; i++) {
+                double start_d, end_d;
+                k_exec_time[i] += compute_kernel_execution_time(kernel_exec_event[i], start_d, end_d);
+                k_images[i] += unit_batch[i];
+                if (b0 == 0) {
+                    k_start_time[i] = start_d;
+                }
+                k_end_time[i] = end_d;
+                if (i == 0 || start_d < chunk_start_time)
+                    chunk_start_time = start_d;
+                if (i == 0 || end_d > chunk_end_time)
+                    chunk_end_time = end_d;
+                clReleaseEvent(kernel_exec_event[i]);
+            }
+            k_overall_exec_time += chunk_end_time - chunk_start_time;
+        }
+
+        printf("\n===== Host-CPU transferring result matrix from the FPGA device global memory (DDR4) via PCIe ======\n\n");
+
+        // Read the results back from the device, blocking read; a
+        // persistent chunk is read back in drain_chunk
+        if (zrle) {
+            zrle_read(output_win, chunk_output, output_region.size / sizeof(cnndata_t));
+        } else if (!native_backend && !persistent) {
+            status = clEnqueueReadBuffer(
+                        xfer_queue, // using a special queue for reading buffer C
+                        output_win,
+                        CL_TRUE,
+                        0,
+                        output_region.size,
+                        chunk_output,
                         0,
                         NULL,
-                        &kernel_exec_event[i]
-                        );
-        CHECK(status);
-    }
-    // printf(" *** FPGA execution started!\n");
+                        NULL); CHECK(status);
+        }
 
-    for(i = 0; i < NUM_KERNELS_TO_CREATE; i++) {
-        status = clFlush(cmdQueue[i]);
-        CHECK(status);
-    }
+        if (cpu_run) {
+            double dev_time = getCurrentTimestamp() - dev_start;
+            pthread_join(cpu_thread, NULL);
+
+            // Work in images, a channel split counts its share of one image
+            double cpu_work = cpu_batch, dev_work = chunk_batch;
+            if (m_split < dev_params.M_ofm) {
+                uint64_t m, r, c;
+                for (m = m_split; m < dev_params.M_ofm; m++)
+                    for (r = 0; r < dev_params.R_ofm; r++)
+                        for (c = 0; c < dev_params.C_ofm; c++)
+                            ARRAYo(dt_output, b0, m, r, c, batch_size, dev_params.M_ofm, dev_params.R_ofm,
+                                   dev_params.C_ofm) = ARRAYo(cpu_scratch, 0, m, r, c, 1, dev_params.M_ofm,
+                                                              dev_params.R_ofm, dev_params.C_ofm);
+                unit_params[0].m_end = dev_params.M_ofm;
+                if (!native_backend) {
+                    status = clSetKernelArg(kernel[0], 5, sizeof(layer_size), (void*)&unit_params[0]);
+                    CHECK(status);
+                }
+                cpu_work = (double)(dev_params.M_ofm - m_split) / dev_params.M_ofm;
+                dev_work = 1 - cpu_work;
+            }
+            cpu_images += cpu_work;
+            cpu_time += task.time;
+            cpu_dev_images += dev_work;
+            cpu_dev_time += dev_time;
+
+            // The share at which both sides would have finished together
+            if (cpu_adapt && task.time > 0 && dev_time > 0) {
+                double cpu_rate = cpu_work / task.time, dev_rate = dev_work / dev_time;
+                cpu_share = cpu_rate / (cpu_rate + dev_rate);
+            }
+        }
 
-    for(i = 0; i < NUM_QUEUES_TO_FINISH; i++) {
-        status = clFinish(cmdQueue[i]); CHECK(status);
+        if (!native_backend && !persistent) {
+            clReleaseMemObject(input_win);
+            clReleaseMemObject(output_win);
+        }
     }
-    const double start_time2 = getCurrentTimestamp();
 
-    printf(" *** FPGA execution finished!\n");
-    
-    double k_start_time[NUM_QUEUES_TO_FINISH];
-    double k_end_time[NUM_QUEUES_TO_FINISH];
-    double k_exec_time[NUM_QUEUES_TO_FINISH];
-
-    for (i = 0; i < NUM_QUEUES_TO_FINISH; i++) {
-        k_exec_time[i] = compute_kernel_execution_time(kernel_exec_event[i], k_start_time[i], k_end_time[i]);
+    if (cpu_scratch != NULL) {
+        acl_aligned_free(cpu_scratch);
     }
 
-    printf("\n===== Host-CPU transferring result matrix from the FPGA device global memory (DDR4) via PCIe ======\n\n");
-    
-    // Read the results back from the device, blocking read
-    clEnqueueReadBuffer(
-                cmdQueue[0*NUM_KERNELS_TO_CREATE], // using a special queue for reading buffer C
-                output_buf,
-                CL_TRUE,
-                0,
-                num_elem_outputs * sizeof(cnndata_t),
-                dt_output,
-                0,
-                NULL,
-                NULL); CHECK(status);
+    // Read back the last chunk and stop the persistent kernel, its event
+    // spans every job
+    if (persistent) {
+        if (pending.job > 0) {
+            k_overall_exec_time += drain_chunk(&pending, &last_done);
+        }
+        cnn_job stop = { 0, 0, 0, 0, dev_params };
+        post_job(&stop);
+        status = clFinish(cmdQueue[0]); CHECK(status);
+        k_exec_time[0] = compute_kernel_execution_time(kernel_exec_event[0], k_start_time[0], k_end_time[0]);
+        clReleaseEvent(kernel_exec_event[0]);
+    }
 
     printf("\n===== Comparing FPGA results to golden reference ======\n\n");
 
@@ -790,81 +2266,274 @@ void run() {
     {
         uint64_t iter;
         for(iter=0;iter < batch_size; iter++) { 
-            ZhangIsfpga15_1_fp(&ARRAY4(ref_input, iter, 0, 0, 0,
-                                       batch_size, layer_params.N_ifm, layer_params.R_ifm,
-                                       layer_params.C_ifm),
-                               &ARRAY4(ref_output, iter, 0, 0, 0, batch_size, layer_params.M_ofm,
-                                       layer_params.R_ofm, layer_params.C_ofm),
-                               ref_weights);
-            verify(&ARRAY4(ref_output, iter, 0, 0, 0, batch_size, layer_params.M_ofm,
-                           layer_params.R_ofm, layer_params.C_ofm),
-                   &ARRAYo(dt_output, iter, 0, 0, 0, batch_size, layer_params.M_ofm,
-                           layer_params.R_ofm, layer_params.C_ofm));
+            memset(ref_output, 0, layer_params.M_ofm * layer_params.R_ofm * layer_params.C_ofm * sizeof(cnndata_t));
+            ZhangIsfpga15_1_fp(ref_input_image(iter), ref_output, ref_weights);
+            verify(ref_output,
+                   &ARRAYo(dt_output, iter, 0, 0, 0, batch_size, dev_params.M_ofm,
+                           dev_params.R_ofm, dev_params.C_ofm));
         }    
     }
     
     printf("\n===== Reporting measured throughput ======\n\n");
-    double k_earliest_start_time = k_start_time[0];
-    double k_latest_end_time     = k_end_time[0];
 
-    for (i = 1; i < NUM_QUEUES_TO_FINISH; i++) {
-
-        if (k_start_time[i] < k_earliest_start_time)
-            k_earliest_start_time   = k_start_time[i];
-
-        if (k_end_time[i]   > k_latest_end_time)
-            k_latest_end_time       = k_end_time[i];
-    }
-
-    // IMPORTANT: we care about the finish time of drain_C, once data is drained we are done
-    k_latest_end_time       = k_end_time[0];
-
-
-    for(i = 0; i < NUM_QUEUES_TO_FINISH; i++) {
+    for(i = 0; i < num_units; i++) {
         printf("  Kernel execution time on FPGA: %s, \n   \t\t\t\t\t\texec time = %.5f s, start=%.5f s, end=%.5f s\n", kernel_name[i], k_exec_time[i], k_start_time[i], k_end_time[i]);
+        if (num_units > 1 && m_partition) {
+            printf("   \t\t\t\t\t\tchannels = %lu-%lu (%.1f%%), busy %.1f%% of the CNN exec time\n",
+                   unit_params[i].m_first, unit_params[i].m_end - 1,
+                   100.0 * (unit_params[i].m_end - unit_params[i].m_first) / dev_params.M_ofm,
+                   k_overall_exec_time > 0 ? 100.0 * k_exec_time[i] / k_overall_exec_time : 0.0);
+        } else if (num_units > 1) {
+            // Each unit's share of the batch and how long it kept its datapath busy
+            printf("   \t\t\t\t\t\timages = %lu (%.1f%%), busy %.1f%% of the CNN exec time\n",
+                   k_images[i], 100.0 * k_images[i] / batch_size,
+                   k_overall_exec_time > 0 ? 100.0 * k_exec_time[i] / k_overall_exec_time : 0.0);
+        }
     }
 
-    double k_overall_exec_time = k_latest_end_time - k_earliest_start_time;
-
+    // Kernel time summed over the chunks, transfers between chunks excluded
     printf("\n");
-    printf("  FPGA CNN exec time\t\t= %.5f s\n", k_overall_exec_time);
+    printf("  FPGA CNN exec time\t\t= %.5f s (%lu chunks)\n", k_overall_exec_time,
+           (batch_size + chunk_size - 1) / chunk_size);
+    if (cpu_images > 0) {
+        printf("  CPU co-execution\t\t= %.2f images on the CPU (%.1f%%), CPU %.2f images/s, device %.2f images/s, "
+               "final share %.3f\n", cpu_images, 100.0 * cpu_images / batch_size, cpu_images / cpu_time,
+               cpu_dev_images / cpu_dev_time, cpu_share);
+    }
+    if (job_images > 0) {
+        printf("  Job launches\t\t\t= %lu jobs in %lu launches, launch overhead %.3f ms per launch, %.3f ms per job\n",
+               jobs_launched, job_launches, job_launch_overhead / job_launches * 1.0e3,
+               job_launch_overhead / jobs_launched * 1.0e3);
+    }
+    if (persistent) {
+        // Doorbell to done including the polling reads, the stop job not counted
+        printf("  Persistent kernel\t\t= %lu jobs, %.3f ms per job, resident %.5f s\n", jobs_posted - 1,
+               k_overall_exec_time / (jobs_posted - 1) * 1.0e3, k_exec_time[0]);
+    }
     //printf("       FPGA CNN exec time\t\t= %.5f s\n", start_time2-start_time1);
 
     // multiplied by 1.0e-9 to get G-FLOPs
     printf("\n");
 
     double num_operations = batch_size * (double)2.0 * layer_params.M_ofm * layer_params.R_ofm * 
-        layer_params.C_ofm * layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts;
+        layer_params.C_ofm * (layer_params.N_ifm / layer_params.groups) * layer_params.K_wts * layer_params.K_wts;
 
     printf("  # operations = %.0f\n", num_operations );
-    printf("  Throughput: %.5f GFLOPS\n", (double)1.0e-9 * num_operations / k_overall_exec_time);
+    printf("  Throughput: %.5f GFLOPS%s\n", (double)1.0e-9 * num_operations / k_overall_exec_time,
+           conv_engine == ENGINE_SPARSE ? " (dense-equivalent)" : "");
+
+    if (conv_engine == ENGINE_SPARSE) {
+        // The throughput above counts the dense operations of the layer
+        uint64_t Ng = layer_params.N_ifm / layer_params.groups;
+        uint64_t blocks = layer_params.M_ofm * CEIL_DIV(Ng, SP_BN);
+        double sparse_operations = num_operations * sparse_blocks_kept / blocks;
+        printf("  Sparse weights: %lu of %lu blocks kept (%.1f%%), %.2f MB vs %.2f MB dense\n",
+               sparse_blocks_kept, blocks, 100.0 * sparse_blocks_kept / blocks,
+               num_elem_weights * sizeof(cnndata_t) / 1.0e6,
+               layer_params.M_ofm * Ng * layer_params.K_wts * layer_params.K_wts * sizeof(cnndata_t) / 1.0e6);
+        printf("  Throughput on kept blocks: %.5f GFLOPS (%.0f operations)\n",
+               (double)1.0e-9 * sparse_operations / k_overall_exec_time, sparse_operations);
+    }
+
+    if (conv_engine == ENGINE_DIRECT && layer_params.groups > 1) {
+        // The tile loops cover one group's channels, lanes past Ng stay idle,
+        // and the blocked layouts pad the Ng channels of each row up to TN
+        uint64_t Ng = dev_params.N_ifm / dev_params.groups;
+        double issued_macs = batch_size * (double)ROUND_UP(dev_params.R_ofm, kernel_params.Tr) *
+            ROUND_UP(dev_params.C_ofm, kernel_params.Tc) * ROUND_UP(dev_params.M_ofm, kernel_params.Tm) *
+            ROUND_UP(Ng, kernel_params.Tn) * dev_params.K_wts * dev_params.K_wts;
+        printf("  Groups: %lu channels per group on Tn = %lu lanes, %.1f%% MAC utilization\n",
+               Ng, kernel_params.Tn, 100.0 * num_operations / 2 / issued_macs);
+        printf("  Grouped weights: %.1f KB on the device vs %.1f KB unpadded\n",
+               num_elem_weights * sizeof(cnndata_t) / 1.0e3,
+               layer_params.M_ofm * (layer_params.N_ifm / layer_params.groups) *
+               layer_params.K_wts * layer_params.K_wts * sizeof(cnndata_t) / 1.0e3);
+    }
+
+    // DDR weight traffic of the tile loops, batch_size passes without batch
+    // tiling; each pass refetches the weight tiles as model_traffic() counts
+    if (conv_engine == ENGINE_DIRECT) {
+        double input_bytes, weight_bytes, output_bytes, weight_bytes_tb1;
+        model_traffic(weight_passes, &input_bytes, &weight_bytes, &output_bytes);
+        model_traffic(batch_size, &input_bytes, &weight_bytes_tb1, &output_bytes);
+        printf("  Weight reads from DDR: %lu passes, %.2f MB (Tb = %lu, %.2f MB with Tb = 1)\n",
+               weight_passes, weight_bytes / 1.0e6, kernel_params.Tb, weight_bytes_tb1 / 1.0e6);
+    } else if (conv_engine == ENGINE_POINTWISE) {
+        printf("  Weight reads from DDR: %lu passes, %.2f MB (%.2f MB once per image)\n",
+               weight_passes, weight_passes * num_elem_weights * sizeof(cnndata_t) / 1.0e6,
+               batch_size * num_elem_weights * sizeof(cnndata_t) / 1.0e6);
+    }
+
+    {
+        double input_bytes, weight_bytes, output_bytes;
+        model_traffic(weight_passes, &input_bytes, &weight_bytes, &output_bytes);
+        if (conv_engine == ENGINE_POINTWISE) {
+            printf("  Pointwise: modeled DDR traffic %.2f MB (inputs %.2f, weights %.2f, outputs %.2f)\n",
+                   (input_bytes + weight_bytes + output_bytes) / 1.0e6,
+                   input_bytes / 1.0e6, weight_bytes / 1.0e6, output_bytes / 1.0e6);
+        } else if (conv_engine == ENGINE_GEMM) {
+            printf("  im2col + GEMM: modeled DDR traffic %.2f MB (im2col %.2f, weights %.2f, outputs %.2f)\n",
+                   (input_bytes + weight_bytes + output_bytes) / 1.0e6,
+                   input_bytes / 1.0e6, weight_bytes / 1.0e6, output_bytes / 1.0e6);
+        } else if (conv_engine == ENGINE_SPARSE) {
+            printf("  Block-sparse: modeled DDR traffic %.2f MB (inputs %.2f, weights %.2f, outputs %.2f)\n",
+                   (input_bytes + weight_bytes + output_bytes) / 1.0e6,
+                   input_bytes / 1.0e6, weight_bytes / 1.0e6, output_bytes / 1.0e6);
+        } else if (conv_engine == ENGINE_LINEBUF) {
+            printf("  Line buffer: modeled DDR traffic %.2f MB (inputs %.2f, weights %.2f, outputs %.2f)\n",
+                   (input_bytes + weight_bytes + output_bytes) / 1.0e6,
+                   input_bytes / 1.0e6, weight_bytes / 1.0e6, output_bytes / 1.0e6);
+        } else {
+            printf("  Loop order %s,%s,%s,%s: modeled DDR traffic %.2f MB (inputs %.2f, weights %.2f, outputs %.2f)\n",
+                   loop_name[loop_order[0]], loop_name[loop_order[1]], loop_name[loop_order[2]],
+                   loop_name[loop_order[3]], (input_bytes + weight_bytes + output_bytes) / 1.0e6,
+                   input_bytes / 1.0e6, weight_bytes / 1.0e6, output_bytes / 1.0e6);
+        }
+    }
+
+    // Operations of the layer the kernel runs, see conv_params
+    double conv_operations = batch_size * (double)2.0 * conv_params.M_ofm * conv_params.R_ofm *
+        conv_params.C_ofm * (conv_params.N_ifm / conv_params.groups) * conv_params.K_wts * conv_params.K_wts;
+
+    if (phase_S > 1) {
+        // Phase weights past the K x K window are zero but still multiplied
+        printf("\n");
+        printf("  Stride phases: %lu x %lu, K_wts %lu -> %lu, +%.1f%% operations on zero weights\n",
+               phase_S, phase_S, layer_params.K_wts, conv_params.K_wts,
+               100.0 * (conv_operations / num_operations - 1));
+    }
+
+    if (EXACT_TILES) {
+        // The kernel also computes the zero padding; its share of the MACs
+        // is the price paid for the exact trip counts
+        double padded_operations = batch_size * (double)2.0 * dev_params.M_ofm * dev_params.R_ofm * 
+            dev_params.C_ofm * dev_params.N_ifm * dev_params.K_wts * dev_params.K_wts;
+        double unpadded_bytes = (double)sizeof(cnndata_t) *
+            (SIZEi(batch_size, conv_params.N_ifm, conv_params.R_ifm, conv_params.C_ifm) +
+             SIZEw(conv_params.M_ofm, conv_params.N_ifm, conv_params.K_wts, conv_params.K_wts) +
+             SIZEo(batch_size, conv_params.M_ofm, conv_params.R_ofm, conv_params.C_ofm));
+        double padded_bytes = (double)sizeof(cnndata_t) * (num_elem_inputs + num_elem_weights + num_elem_outputs);
+
+        printf("\n");
+        printf("  Tile padding: +%.1f%% operations, +%.1f%% device bytes\n",
+               100.0 * (padded_operations / conv_operations - 1), 100.0 * (padded_bytes / unpadded_bytes - 1));
+        printf("  Throughput incl. padding: %.5f GFLOPS\n",
+               (double)1.0e-9 * padded_operations / k_overall_exec_time);
+        printf("  Time spent on padding\t= %.5f s (compare against an EXACT_TILES=0 build)\n",
+               k_overall_exec_time * (1 - conv_operations / padded_operations));
+    }
+
+    // Reported separately from the kernel time above
+    printf("\n");
+    printf("  Host layout transposes\t= %.5f s\n", transpose_time);
+    if (conv_engine == ENGINE_GEMM) {
+        printf("  Host im2col\t\t\t= %.5f s\n", im2col_time);
+    }
+    if (!wcache_dir.empty()) {
+        printf("  Weight cache hash/IO\t= %.5f s (%s)\n", wcache_time,
+               wcache_map.data != NULL ? "hit" : "miss");
+    }
+
+    if (zrle) {
+        // The dense transfers are priced at the PCIe rate seen by the packed ones
+        double dense_bytes = zrle_dense_bytes[0] + zrle_dense_bytes[1];
+        double packed_bytes = zrle_packed_bytes[0] + zrle_packed_bytes[1];
+        double dense_time = zrle_pcie_time * dense_bytes / packed_bytes;
+        double zrle_total = zrle_pcie_time + zrle_device_time + zrle_host_time;
+        printf("\n");
+        printf("  Zero-RLE to device: %.2f MB -> %.2f MB (x%.2f), from device: %.2f MB -> %.2f MB (x%.2f)\n",
+               zrle_dense_bytes[0] / 1.0e6, zrle_packed_bytes[0] / 1.0e6, zrle_dense_bytes[0] / zrle_packed_bytes[0],
+               zrle_dense_bytes[1] / 1.0e6, zrle_packed_bytes[1] / 1.0e6, zrle_dense_bytes[1] / zrle_packed_bytes[1]);
+        printf("  Zero-RLE transfers\t= %.5f s, device codec %.5f s, host codec %.5f s\n",
+               zrle_pcie_time, zrle_device_time, zrle_host_time);
+        printf("  Dense transfers\t= %.5f s (estimated), net saving %.5f s\n",
+               dense_time, dense_time - zrle_total);
+    }
     //printf("       Throughput: %.5f GFLOPS\n", (double)1.0e-9 * num_operations / (start_time2-start_time1));
 
     printf("\n");
     printf("DONE\n");
 }
 
-void ZhangIsfpga15_1_fp(cnndata_t *input, cnndata_t *output, cnndata_t *weights) {
-    printf("Computing reference output\n");
-    unsigned long row, col, to, ti;
+/* DDR traffic of the tile loops in loop_order, assuming one on-chip
+ * tile per tensor (per image for activations).  A tile is refetched
+ * each time a loop it depends on, or any loop outside that one,
+ * advances; loops nested inside the innermost such loop reuse it.
+ * Output tiles are read and written. */
+void model_traffic(uint64_t weight_passes, double *input_bytes, double *weight_bytes, double *output_bytes) {
+    const uint64_t S = dev_params.S_wts, K = dev_params.K_wts;
+    const uint64_t Tr = kernel_params.Tr, Tc = kernel_params.Tc;
+    const uint64_t Tm = kernel_params.Tm, Tn = kernel_params.Tn;
+    double trips[NUM_TILE_LOOPS];
+    // Loops each tensor's tile depends on; in grouped layers the input
+    // channels follow the group of the output tile
+    const bool input_uses[NUM_TILE_LOOPS]  = { true,  true,  dev_params.groups > 1, true  };
+    const bool weight_uses[NUM_TILE_LOOPS] = { false, false, true,  true  };
+    const bool output_uses[NUM_TILE_LOOPS] = { true,  true,  true,  false };
+    double input_fetches = 1, weight_fetches = 1, output_fetches = 1, outer = 1;
+    int level;
+
+    trips[LOOP_ROW] = CEIL_DIV(dev_params.R_ofm, Tr);
+    trips[LOOP_COL] = CEIL_DIV(dev_params.C_ofm, Tc);
+    trips[LOOP_TO]  = CEIL_DIV(dev_params.M_ofm, Tm);
+    trips[LOOP_TI]  = CEIL_DIV(dev_params.N_ifm / dev_params.groups, Tn);
+
+    // cnn_pointwise reads the inputs once per PW_BM rows of weights and
+    // the weights once per PW_BQ output pixels of the chunk
+    if (conv_engine == ENGINE_POINTWISE) {
+        *input_bytes = (double)CEIL_DIV(dev_params.M_ofm, PW_BM) * batch_size * dev_params.N_ifm *
+            dev_params.K_wts * dev_params.K_wts * dev_params.R_ofm * dev_params.C_ofm * sizeof(cnndata_t);
+        *weight_bytes = weight_passes * (double)num_elem_weights * sizeof(cnndata_t);
+        *output_bytes = (double)num_elem_outputs * sizeof(cnndata_t);
+        return;
+    }
 
-    for(row = 0; row < layer_params.R_ofm; row++) {
-        for(col = 0; col < layer_params.C_ofm; col++) {
-            for(to = 0; to < layer_params.M_ofm; to++) {
-                for(ti = 0; ti < layer_params.N_ifm; ti++) {
-                    unsigned long i, j;
-                    for(i = 0; i < layer_params.K_wts; i++) {
-                        for(j = 0; j < layer_params.K_wts; j++) {
-                            ARRAY4(output, 0, to, row, col, 0, layer_params.M_ofm, layer_params.R_ofm, layer_params.C_ofm) += 
-                                ARRAY4(weights, to, ti, i, j, layer_params.M_ofm, layer_params.N_ifm, layer_params.K_wts, layer_params.K_wts)*
-                                ARRAY4(input, 0, ti, layer_params.S_wts *row + i, layer_params.S_wts * col + j, 
-                                    0, layer_params.N_ifm, layer_params.R_ifm, layer_params.C_ifm);
-                        }
-                    }
-                }
-            }
-        }
+    // cnn_sparse reads the input planes and the output plane of each kept
+    // block once per image, the compressed weights once per image
+    if (conv_engine == ENGINE_SPARSE) {
+        *input_bytes = (double)batch_size * sparse_blocks_kept * SP_BN * dev_params.R_ifm * dev_params.C_ifm *
+            sizeof(cnndata_t);
+        *weight_bytes = weight_passes * (double)num_elem_weights * sizeof(cnndata_t);
+        *output_bytes = 2.0 * batch_size * sparse_blocks_kept * dev_params.R_ofm * dev_params.C_ofm * sizeof(cnndata_t);
+        return;
+    }
+
+    // cnn_gemm reads the im2col matrix once per GEMM_BS rows of weights
+    // and the weights once per GEMM_BS output pixels
+    if (conv_engine == ENGINE_GEMM) {
+        const uint64_t P = layer_params.R_ofm * layer_params.C_ofm;
+        const double Kd = layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts;
+        *input_bytes = batch_size * CEIL_DIV(layer_params.M_ofm, GEMM_BS) * Kd * P * sizeof(cnndata_t);
+        *weight_bytes = batch_size * CEIL_DIV(P, GEMM_BS) * layer_params.M_ofm * Kd * sizeof(cnndata_t);
+        *output_bytes = batch_size * layer_params.M_ofm * P * sizeof(cnndata_t);
+        return;
+    }
+
+    // The line-buffer kernel reads each input pixel once per to tile and
+    // each output pixel once per ti tile
+    if (conv_engine == ENGINE_LINEBUF) {
+        *input_bytes = batch_size * trips[LOOP_TO] * dev_params.N_ifm * dev_params.R_ifm * dev_params.C_ifm * sizeof(cnndata_t);
+        *weight_bytes = weight_passes * (double)num_elem_weights * sizeof(cnndata_t);
+        *output_bytes = 2 * batch_size * trips[LOOP_TI] * dev_params.M_ofm * dev_params.R_ofm * dev_params.C_ofm * sizeof(cnndata_t);
+        return;
     }
+
+    for (level = 0; level < NUM_TILE_LOOPS; level++) {
+        int l = loop_order[level];
+        outer *= trips[l];
+        if (input_uses[l])  input_fetches = outer;
+        if (weight_uses[l]) weight_fetches = outer;
+        if (output_uses[l]) output_fetches = outer;
+    }
+
+    *input_bytes = batch_size * input_fetches * Tn * ((Tr - 1) * S + K) * ((Tc - 1) * S + K) * sizeof(cnndata_t);
+    *weight_bytes = weight_passes * weight_fetches * Tm * Tn * K * K * sizeof(cnndata_t);
+    *output_bytes = 2 * batch_size * output_fetches * Tm * Tr * Tc * sizeof(cnndata_t);
+}
+
+void ZhangIsfpga15_1_fp(cnndata_t *input, cnndata_t *output, cnndata_t *weights) {
+    printf("Computing reference output\n");
+    ref_conv(input, output, weights, &layer_params);
 }
 
 void verify(cnndata_t *ref, cnndata_t *checkit) {
@@ -875,8 +2544,8 @@ void verify(cnndata_t *ref, cnndata_t *checkit) {
     for(to = 0; to < layer_params.M_ofm; to++) {
         for(row = 0; row < layer_params.R_ofm; row++) {
             for(col = 0; col < layer_params.C_ofm ; col++) {
-                if (!(nearlyEqual((cnndata_t)ARRAYo(checkit, 0, to, row, col, 0, layer_params.M_ofm,
-                                                    layer_params.R_ofm, layer_params.C_ofm),
+                if (!(nearlyEqual((cnndata_t)ARRAYo(checkit, 0, to, row, col, 0, dev_params.M_ofm,
+                                                    dev_params.R_ofm, dev_params.C_ofm),
                                   (cnndata_t)ARRAY4(ref, 0, to, row, col, 0, layer_params.M_ofm,
                                                     layer_params.R_ofm, layer_params.C_ofm)))) {
                     printf("Result does not match reference: layer=%lu, row=%lu, col=%lu\n.",
@@ -890,22 +2559,6 @@ void verify(cnndata_t *ref, cnndata_t *checkit) {
     printf("Results correct.\n\n");
 }
 
-int nearlyEqual(cnndata_t a, cnndata_t b) {
-    cnndata_t absA = fabs(a);
-    cnndata_t absB = fabs(b);
-    cnndata_t diff = fabs(a - b);
-
-    if (a == b) { // shortcut, handles infinities
-        return 1;
-    } else if (a == 0 || b == 0 || diff < FLT_MIN) {
-        // a or b is zero or both are extremely close to it
-        // relative error is less meaningful here
-        return diff < (EPSILON * FLT_MIN);
-    } else { // use relative error
-        return diff / fmin((absA + absB), FLT_MAX) < EPSILON;
-    }
-}
-
 // Free the resources allocated during initialization
 void cleanup() {
     //----------------------------------------------
@@ -917,10 +2570,6 @@ void cleanup() {
         clReleaseKernel(kernel[i]);
     }
 
-    for(i=0; i<NUM_QUEUES_TO_FINISH; i++) {
-        clReleaseEvent(kernel_exec_event[i]);
-    }
-
     for(i=0; i<NUM_QUEUES_TO_CREATE; i++) {
         clReleaseCommandQueue(cmdQueue[i]);
     }
@@ -928,17 +2577,60 @@ void cleanup() {
     clReleaseMemObject(input_buf);
     clReleaseMemObject(weight_buf);
     clReleaseMemObject(output_buf);
+    if (job_images > 0) {
+        clReleaseMemObject(job_table_buf);
+    }
+    if (persistent) {
+        clReleaseMemObject(job_buf);
+        clReleaseMemObject(ring_buf);
+    }
+    if (zrle) {
+        clReleaseKernel(zrle_kernel[0]);
+        clReleaseKernel(zrle_kernel[1]);
+        clReleaseMemObject(zrle_buf);
+    }
 
-    acl_aligned_free(dt_input);
-    acl_aligned_free(dt_output);
-    acl_aligned_free(dt_weights);
+    if (dt_input != input_map.data) {
+        acl_aligned_free(dt_input);
+    }
+    if (dt_output != output_map.data) {
+        acl_aligned_free(dt_output);
+    }
+    if (dt_weights != weights_map.data && dt_weights != wcache_map.data) {
+        acl_aligned_free(dt_weights);
+    }
 
+    if (ref_weights != dt_weights && ref_weights != weights_map.data) {
+        acl_aligned_free(ref_weights);
+    }
     acl_aligned_free(ref_input);
+    acl_aligned_free(ph_input);
+    acl_aligned_free(dt_im2col);
+    acl_aligned_free(zrle_host);
     acl_aligned_free(ref_output);
-    acl_aligned_free(ref_weights);
+
+    unmap_tensor(&input_map);
+    unmap_tensor(&weights_map);
+    unmap_tensor(&wcache_map);
+    unmap_tensor(&output_map);
 
     clReleaseProgram(program);
     clReleaseContext(context);
 
     acl_aligned_free(devices);
 }
+
+/* Cycles of the MAC arrays, the cost the engine choice is based on.  The
+ * direct kernel spends one cycle per (row, col, i, j) of each (to, ti)
+ * tile on its Tm x Tn array, so partial to and ti tiles idle part of it;
+ * cnn_gemm spends one cycle per k of each GEMM_BS x GEMM_BS block. */
+void model_engine_cycles(double *direct, double *gemm) {
+    const uint64_t R = EXACT_TILES ? ROUND_UP(conv_params.R_ofm, kernel_params.Tr) : conv_params.R_ofm;
+    const uint64_t C = EXACT_TILES ? ROUND_UP(conv_params.C_ofm, kernel_params.Tc) : conv_params.C_ofm;
+    const uint64_t P = layer_params.R_ofm * layer_params.C_ofm;
+
+    *direct = (double)batch_size * CEIL_DIV(conv_params.M_ofm, kernel_params.Tm) *
+        CEIL_DIV(conv_params.N_ifm / conv_params.groups, kernel_params.Tn) * R * C * conv_params.K_wts * conv_params.K_wts;
+    *gemm = (double)batch_size * CEIL_DIV(layer_params.M_ofm, GEMM_BS) * CEIL_DIV(P, GEMM_BS) *
+        layer_params.N_ifm * layer_params.K_wts * layer_params.K_wts;
+}
@@ -0,0 +1,216 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Native backend, see native643.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "native643.h"
+#include "layout643.h"
+
+#if NATIVE_KERNELS
+
+// The kernel names stay out of the host's namespace.  cnn.cl includes
+// the 643 headers again, their guards skip them.
+namespace device {
+#include "clshim643.h"
+#include "../../device/cnn.cl"
+}
+
+typedef struct native_job {
+    int engine;
+    const cnndata_t *input;
+    const cnndata_t *weights;
+    cnndata_t *output;
+    uint64_t input_image, output_image;
+    kernel_size kernel;
+    layer_size layer;
+} native_job;
+
+static void native_images(uint64_t begin, uint64_t end, void *ctx) {
+    const native_job *job = (const native_job*)ctx;
+    const cnndata_t *input = job->input + begin * job->input_image;
+    cnndata_t *output = job->output + begin * job->output_image;
+
+    switch (job->engine) {
+#if GEMM_BS > 0
+    case ENGINE_GEMM:
+        device::cnn_gemm(input, job->weights, output, end - begin, job->kernel, job->layer);
+        break;
+#endif
+#if PW_BQ > 0
+    case ENGINE_POINTWISE:
+        device::cnn_pointwise(input, job->weights, output, end - begin, job->kernel, job->layer);
+        break;
+#endif
+#if SP_BN > 0
+    case ENGINE_SPARSE:
+        device::cnn_sparse(input, job->weights, output, end - begin, job->kernel, job->layer);
+        break;
+#endif
+    default:
+        device::cnn(input, job->weights, output, end - begin, job->kernel, job->layer);
+        break;
+    }
+}
+
+void native_launch(int engine, const cnndata_t *input, const cnndata_t *weights, cnndata_t *output,
+                   uint64_t batch, uint64_t input_image, uint64_t output_image,
+                   const kernel_size *kernel, const layer_size *layer) {
+    native_job job = { engine, input, weights, output, input_image, output_image, *kernel, *layer };
+    parallel_for(batch, native_images, &job);
+}
+
+#define ARG(i, type) (*(const type*)args[i].value)
+
+// The convolution kernels share one argument list
+#define CONV_ENTRY(name) \
+static void run_##name(const native_arg *args) { \
+    device::name((const cnndata_t*)args[0].mem, (const cnndata_t*)args[1].mem, (cnndata_t*)args[2].mem, \
+                 ARG(3, uint64_t), ARG(4, kernel_size), ARG(5, layer_size)); \
+}
+
+CONV_ENTRY(cnn)
+#if NUM_CU > 1
+CONV_ENTRY(cnn_1)
+#endif
+#if NUM_CU > 2
+CONV_ENTRY(cnn_2)
+#endif
+#if NUM_CU > 3
+CONV_ENTRY(cnn_3)
+#endif
+#if GEMM_BS > 0
+CONV_ENTRY(cnn_gemm)
+#endif
+#if PW_BQ > 0
+CONV_ENTRY(cnn_pointwise)
+#endif
+#if SP_BN > 0
+CONV_ENTRY(cnn_sparse)
+#endif
+
+#if ZRLE > 0
+static void run_cnn_unzrle(const native_arg *args) {
+    device::cnn_unzrle((const uint*)args[0].mem, (cnndata_t*)args[1].mem, ARG(2, uint64_t));
+}
+
+static void run_cnn_zrle(const native_arg *args) {
+    device::cnn_zrle((const cnndata_t*)args[0].mem, (uint*)args[1].mem, ARG(2, uint64_t));
+}
+#endif
+
+#if JOB_TABLE > 0
+static void run_cnn_jobs(const native_arg *args) {
+    device::cnn_jobs((const cnndata_t*)args[0].mem, (const cnndata_t*)args[1].mem, (cnndata_t*)args[2].mem,
+                     ARG(3, uint64_t), ARG(4, kernel_size), (const cnn_job*)args[5].mem);
+}
+#endif
+
+#if JOBQ > 0
+static void run_cnn_persistent(const native_arg *args) {
+    device::cnn_persistent((const cnndata_t*)args[0].mem, (const cnndata_t*)args[1].mem, (cnndata_t*)args[2].mem,
+                           (volatile const uint64_t*)args[3].mem, ARG(4, kernel_size),
+                           (volatile uint64_t*)args[5].mem);
+}
+#endif
+
+static const struct {
+    const char *name;
+    native_entry entry;
+} native_kernels[] = {
+    { "cnn", run_cnn },
+#if NUM_CU > 1
+    { "cnn_1", run_cnn_1 },
+#endif
+#if NUM_CU > 2
+    { "cnn_2", run_cnn_2 },
+#endif
+#if NUM_CU > 3
+    { "cnn_3", run_cnn_3 },
+#endif
+#if GEMM_BS > 0
+    { "cnn_gemm", run_cnn_gemm },
+#endif
+#if PW_BQ > 0
+    { "cnn_pointwise", run_cnn_pointwise },
+#endif
+#if SP_BN > 0
+    { "cnn_sparse", run_cnn_sparse },
+#endif
+#if ZRLE > 0
+    { "cnn_unzrle", run_cnn_unzrle },
+    { "cnn_zrle", run_cnn_zrle },
+#endif
+#if JOB_TABLE > 0
+    { "cnn_jobs", run_cnn_jobs },
+#endif
+#if JOBQ > 0
+    { "cnn_persistent", run_cnn_persistent },
+#endif
+};
+
+native_entry native_kernel(const char *name) {
+    unsigned i;
+
+    for (i = 0; i < sizeof(native_kernels) / sizeof(native_kernels[0]); i++) {
+        if (strcmp(native_kernels[i].name, name) == 0) {
+            return native_kernels[i].entry;
+        }
+    }
+    return NULL;
+}
+
+#else
+
+void native_launch(int engine, const cnndata_t *input, const cnndata_t *weights, cnndata_t *output,
+                   uint64_t batch, uint64_t input_image, uint64_t output_image,
+                   const kernel_size *kernel, const layer_size *layer) {
+    printf("ERROR: the host was built with NATIVE_KERNELS=0\n");
+    exit(1);
+}
+
+native_entry native_kernel(const char *name) {
+    return NULL;
+}
+
+#endif
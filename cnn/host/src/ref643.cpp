@@ -0,0 +1,93 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Golden reference, see ref643.h
+ *
+ */
+
+#include <math.h>
+#include <float.h>
+#include "ref643.h"
+
+void ref_conv(const cnndata_t *input, cnndata_t *output, const cnndata_t *weights, const layer_size *layer) {
+    unsigned long row, col, to, ti;
+    // Grouped layers, see layer_size in util643.h
+    unsigned long Ng = layer->N_ifm / layer->groups;
+    unsigned long Mg = layer->M_ofm / layer->groups;
+
+    for(row = 0; row < layer->R_ofm; row++) {
+        for(col = 0; col < layer->C_ofm; col++) {
+            for(to = 0; to < layer->M_ofm; to++) {
+                for(ti = 0; ti < Ng; ti++) {
+                    unsigned long i, j;
+                    for(i = 0; i < layer->K_wts; i++) {
+                        for(j = 0; j < layer->K_wts; j++) {
+                            // Taps in the zero halo add nothing
+                            long r = (long)(layer->S_wts * row + i) - (long)layer->pad_top;
+                            long c = (long)(layer->S_wts * col + j) - (long)layer->pad_left;
+                            if (r < 0 || c < 0 || r >= (long)layer->R_ifm || c >= (long)layer->C_ifm) {
+                                continue;
+                            }
+                            ARRAY4(output, 0, to, row, col, 0, layer->M_ofm, layer->R_ofm, layer->C_ofm) += 
+                                ARRAY4(weights, to, ti, i, j, layer->M_ofm, Ng, layer->K_wts, layer->K_wts)*
+                                ARRAY4(input, 0, (to / Mg) * Ng + ti, r, c, 
+                                    0, layer->N_ifm, layer->R_ifm, layer->C_ifm);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+int nearlyEqual(cnndata_t a, cnndata_t b) {
+    cnndata_t absA = fabs(a);
+    cnndata_t absB = fabs(b);
+    cnndata_t diff = fabs(a - b);
+
+    if (a == b) { // shortcut, handles infinities
+        return 1;
+    } else if (a == 0 || b == 0 || diff < FLT_MIN) {
+        // a or b is zero or both are extremely close to it
+        // relative error is less meaningful here
+        return diff < (EPSILON * FLT_MIN);
+    } else { // use relative error
+        return diff / fmin((absA + absB), FLT_MAX) < EPSILON;
+    }
+}
@@ -0,0 +1,346 @@
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Memory-mapped .npy / raw tensor files, see tensorio643.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tensorio643.h"
+#include "kernel643.h"
+
+#define NPY_MAGIC     "\x93NUMPY"
+#define NPY_MAGIC_LEN 6
+#define NPY_ALIGNMENT 64
+
+static bool has_npy_suffix(const char *path) {
+    size_t len = strlen(path);
+    return len >= 4 && strcmp(path + len - 4, ".npy") == 0;
+}
+
+// Parse a .npy header.  Sets *data_offset and returns the number of
+// elements in the stored shape, or 0 if the header is not a C-order
+// little-endian float32 array.
+static uint64_t parse_npy_header(const char *path, const unsigned char *base, size_t bytes,
+                                 size_t *data_offset) {
+    if (bytes < 10 || memcmp(base, NPY_MAGIC, NPY_MAGIC_LEN) != 0) {
+        printf("%s: not a .npy file\n", path);
+        return 0;
+    }
+
+    size_t header_len, header_start;
+    if (base[6] == 1) {
+        header_len = base[8] | (base[9] << 8);
+        header_start = 10;
+    } else if (bytes >= 12) {
+        header_len = base[8] | (base[9] << 8) | (base[10] << 16) | ((size_t)base[11] << 24);
+        header_start = 12;
+    } else {
+        printf("%s: truncated .npy header\n", path);
+        return 0;
+    }
+    if (header_start + header_len > bytes) {
+        printf("%s: truncated .npy header\n", path);
+        return 0;
+    }
+
+    std::string header((const char*)base + header_start, header_len);
+    if (header.find("'descr': '<f4'") == std::string::npos) {
+        printf("%s: only little-endian float32 ('<f4') .npy files are supported\n", path);
+        return 0;
+    }
+    if (header.find("'fortran_order': False") == std::string::npos) {
+        printf("%s: only C-order .npy files are supported\n", path);
+        return 0;
+    }
+
+    size_t pos = header.find("'shape': (");
+    if (pos == std::string::npos) {
+        printf("%s: .npy header has no shape\n", path);
+        return 0;
+    }
+    const char *p = header.c_str() + pos + strlen("'shape': (");
+    uint64_t count = 1;
+    while (*p && *p != ')') {
+        char *end;
+        unsigned long long dim = strtoull(p, &end, 10);
+        if (end == p) {
+            p++;
+            continue;
+        }
+        count *= dim;
+        p = end;
+    }
+
+    *data_offset = header_start + header_len;
+    return count;
+}
+
+bool map_tensor_file(const char *path, uint64_t num_elem, mapped_tensor *t) {
+    memset(t, 0, sizeof(*t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        printf("%s: cannot stat or empty file\n", path);
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    size_t data_offset = 0;
+    uint64_t file_elem;
+    if (has_npy_suffix(path)) {
+        file_elem = parse_npy_header(path, (const unsigned char*)base, st.st_size, &data_offset);
+        if (file_elem != 0 && data_offset + file_elem * sizeof(cnndata_t) > (size_t)st.st_size) {
+            printf("%s: file is shorter than its .npy shape\n", path);
+            file_elem = 0;
+        }
+    } else {
+        file_elem = st.st_size / sizeof(cnndata_t);
+        if (st.st_size % sizeof(cnndata_t) != 0) {
+            file_elem = 0;
+        }
+    }
+
+    if (file_elem != num_elem) {
+        printf("%s: expected %lu float32 values, file holds %lu\n", path, num_elem, file_elem);
+        munmap(base, st.st_size);
+        return false;
+    }
+
+    // Tensors are streamed front to back into the device buffers
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    t->map_base = base;
+    t->map_bytes = st.st_size;
+    t->data = (cnndata_t*)((char*)base + data_offset);
+    t->num_elem = num_elem;
+    return true;
+}
+
+bool create_tensor_file(const char *path, const uint64_t *shape, int ndim, mapped_tensor *t) {
+    memset(t, 0, sizeof(*t));
+
+    uint64_t num_elem = 1;
+    int d;
+    for (d = 0; d < ndim; d++) {
+        num_elem *= shape[d];
+    }
+
+    // Header padded with spaces so that the data starts 64-byte aligned
+    std::string header;
+    if (has_npy_suffix(path)) {
+        char dict[256];
+        int len = snprintf(dict, sizeof(dict), "{'descr': '<f4', 'fortran_order': False, 'shape': (");
+        for (d = 0; d < ndim; d++) {
+            len += snprintf(dict + len, sizeof(dict) - len, "%s%lu", d ? ", " : "", shape[d]);
+        }
+        snprintf(dict + len, sizeof(dict) - len, "%s), }", ndim == 1 ? "," : "");
+
+        header = dict;
+        size_t total = 10 + header.size() + 1;
+        header.append((NPY_ALIGNMENT - total % NPY_ALIGNMENT) % NPY_ALIGNMENT, ' ');
+        header += '\n';
+
+        size_t header_len = header.size();
+        std::string preamble(NPY_MAGIC, NPY_MAGIC_LEN);
+        preamble += (char)1;
+        preamble += (char)0;
+        preamble += (char)(header_len & 0xff);
+        preamble += (char)(header_len >> 8);
+        header = preamble + header;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    size_t bytes = header.size() + num_elem * sizeof(cnndata_t);
+    if (ftruncate(fd, bytes) != 0) {
+        perror(path);
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+    memcpy(base, header.data(), header.size());
+
+    t->map_base = base;
+    t->map_bytes = bytes;
+    t->data = (cnndata_t*)((char*)base + header.size());
+    t->num_elem = num_elem;
+    return true;
+}
+
+#define WPACK_MAGIC      "643WPACK"
+#define WPACK_HEADER_LEN 64
+
+uint64_t hash_tensor(const cnndata_t *data, uint64_t num_elem) {
+    // FNV-1a over 64-bit words, then over the odd tail element
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t i, word;
+
+    for (i = 0; i + 2 <= num_elem; i += 2) {
+        memcpy(&word, &data[i], sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    if (i < num_elem) {
+        word = 0;
+        memcpy(&word, &data[i], sizeof(cnndata_t));
+        hash = (hash ^ word) * prime;
+    }
+    return (hash ^ num_elem) * prime;
+}
+
+void packed_weights_path(char *path, size_t len, const char *dir, uint64_t hash,
+                         uint64_t M, uint64_t N, uint64_t K) {
+    // The packed layout follows the to/ti nesting of LOOP_ORDER
+    snprintf(path, len, "%s/wpack_%016lx_M%lu_N%lu_K%lu_L%d_TM%d_TN%d_%s.bin",
+             dir, hash, M, N, K, WTS_LAYOUT, TM, TN, TILE_ORDER_STR(LOOP_ORDER));
+}
+
+bool map_packed_weights(const char *path, uint64_t num_elem, mapped_tensor *t) {
+    memset(t, 0, sizeof(*t));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false; // not cached yet
+    }
+
+    struct stat st;
+    size_t bytes = WPACK_HEADER_LEN + num_elem * sizeof(cnndata_t);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != bytes) {
+        printf("%s: stale packed-weight cache entry, repacking\n", path);
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        perror(path);
+        return false;
+    }
+
+    uint64_t stored_elem;
+    memcpy(&stored_elem, (char*)base + 8, sizeof(stored_elem));
+    if (memcmp(base, WPACK_MAGIC, 8) != 0 || stored_elem != num_elem) {
+        printf("%s: stale packed-weight cache entry, repacking\n", path);
+        munmap(base, bytes);
+        return false;
+    }
+
+    madvise(base, bytes, MADV_SEQUENTIAL);
+
+    t->map_base = base;
+    t->map_bytes = bytes;
+    t->data = (cnndata_t*)((char*)base + WPACK_HEADER_LEN);
+    t->num_elem = num_elem;
+    return true;
+}
+
+bool store_packed_weights(const char *path, const cnndata_t *data, uint64_t num_elem) {
+    char header[WPACK_HEADER_LEN];
+    memset(header, 0, sizeof(header));
+    memcpy(header, WPACK_MAGIC, 8);
+    memcpy(header + 8, &num_elem, sizeof(num_elem));
+
+    // Create the cache directory and its parents on first use, like mkdir -p
+    std::string dir(path);
+    size_t slash = 0;
+    while ((slash = dir.find('/', slash + 1)) != std::string::npos) {
+        std::string parent = dir.substr(0, slash);
+        if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+            perror(parent.c_str());
+            return false;
+        }
+    }
+
+    // Write under a temporary name so that readers never map a partial file
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (fp == NULL) {
+        perror(tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(header, sizeof(header), 1, fp) == 1 &&
+              fwrite(data, sizeof(cnndata_t), num_elem, fp) == num_elem;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path) != 0) {
+        perror(path);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void unmap_tensor(mapped_tensor *t) {
+    if (t->map_base == NULL) {
+        return;
+    }
+    munmap(t->map_base, t->map_bytes);
+    memset(t, 0, sizeof(*t));
+}
@@ -0,0 +1,248 @@
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Kernel variant manifest, see variants643.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "variants643.h"
+#include "kernel643.h"
+
+const char *loop_name[NUM_TILE_LOOPS] = { "row", "col", "to", "ti" };
+
+bool parse_loop_order(const char *text, int *loop_order) {
+    bool seen[NUM_TILE_LOOPS] = { false };
+    const char *p = text;
+    int level, l;
+
+    for (level = 0; level < NUM_TILE_LOOPS; level++) {
+        size_t len = strcspn(p, ",");
+
+        for (l = 0; l < NUM_TILE_LOOPS; l++) {
+            if (strlen(loop_name[l]) == len && strncmp(p, loop_name[l], len) == 0) {
+                break;
+            }
+        }
+        if (l == NUM_TILE_LOOPS || seen[l] || (p[len] == ',') != (level < NUM_TILE_LOOPS - 1)) {
+            return false;
+        }
+        seen[l] = true;
+        loop_order[level] = l;
+        p += len + 1;
+    }
+    return true;
+}
+
+bool loop_ti_outer(const int *loop_order) {
+    int level;
+
+    for (level = 0; level < NUM_TILE_LOOPS; level++) {
+        if (loop_order[level] == LOOP_TI || loop_order[level] == LOOP_TO) {
+            return loop_order[level] == LOOP_TI;
+        }
+    }
+    return false;
+}
+
+// The size field named key, NULL if key is not a size
+static uint64_t* variant_size(kernel_variant *v, const char *key) {
+    if (strcmp(key, "K") == 0)  return &v->layer.K_wts;
+    if (strcmp(key, "S") == 0)  return &v->layer.S_wts;
+    if (strcmp(key, "R") == 0)  return &v->layer.R_ofm;
+    if (strcmp(key, "C") == 0)  return &v->layer.C_ofm;
+    if (strcmp(key, "M") == 0)  return &v->layer.M_ofm;
+    if (strcmp(key, "N") == 0)  return &v->layer.N_ifm;
+    if (strcmp(key, "G") == 0)  return &v->layer.groups;
+    if (strcmp(key, "TR") == 0) return &v->tiles.Tr;
+    if (strcmp(key, "TC") == 0) return &v->tiles.Tc;
+    if (strcmp(key, "TM") == 0) return &v->tiles.Tm;
+    if (strcmp(key, "TN") == 0) return &v->tiles.Tn;
+    if (strcmp(key, "TB") == 0) return &v->tiles.Tb;
+    return NULL;
+}
+
+static bool parse_variant(char *line, kernel_variant *v) {
+    static const int default_order[NUM_TILE_LOOPS] = { LOOP_ROW, LOOP_COL, LOOP_TO, LOOP_TI };
+    char *tok = strtok(line, " \t\r\n");
+
+    memset(&v->layer, 0, sizeof(v->layer));
+    memset(&v->tiles, 0, sizeof(v->tiles));
+    v->prefix = tok;
+    v->act_layout = v->wts_layout = v->exact_tiles = 0;
+    v->engine = ENGINE_DIRECT;
+    memcpy(v->loop_order, default_order, sizeof(default_order));
+    v->num_fixed = 0;
+
+    while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+        char *value = strchr(tok, '=');
+        uint64_t *size;
+
+        if (value == NULL) {
+            return false;
+        }
+        *value++ = '\0';
+
+        if ((size = variant_size(v, tok)) != NULL) {
+            if ((*size = strtoull(value, NULL, 10)) == 0) {
+                return false;
+            }
+            v->num_fixed++;
+        } else if (strcmp(tok, "ACT") == 0) {
+            v->act_layout = atoi(value);
+        } else if (strcmp(tok, "WTS") == 0) {
+            v->wts_layout = atoi(value);
+        } else if (strcmp(tok, "EXACT") == 0) {
+            v->exact_tiles = atoi(value);
+        } else if (strcmp(tok, "ENGINE") == 0) {
+            v->engine = atoi(value);
+        } else if (strcmp(tok, "ORDER") == 0) {
+            if (!parse_loop_order(value, v->loop_order)) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+void load_variant_manifest(const char *path, std::vector<kernel_variant> &variants) {
+    FILE *fp = fopen(path, "r");
+    char line[1024];
+    int line_no = 0;
+
+    variants.clear();
+    if (fp == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        kernel_variant v;
+        char *comment = strchr(line, '#');
+
+        line_no++;
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (!parse_variant(line, &v)) {
+            printf("%s:%d: malformed kernel variant, skipped\n", path, line_no);
+            continue;
+        }
+        variants.push_back(v);
+    }
+    fclose(fp);
+}
+
+// A fixed size matches when it equals the wanted one, or nothing is wanted
+static bool size_matches(uint64_t fixed, uint64_t wanted) {
+    return fixed == 0 || wanted == 0 || fixed == wanted;
+}
+
+// The tile size a variant would run with: its own, the wanted one or the default
+static uint64_t tile_size(uint64_t fixed, uint64_t wanted, uint64_t dflt) {
+    return fixed ? fixed : (wanted ? wanted : dflt);
+}
+
+// The limits read_params() puts on the line-buffer engine, see LB_MAX_* in kernel643.h
+static bool linebuf_fits(const kernel_variant *v, const layer_size *layer, const kernel_size *tiles) {
+    uint64_t Tm = tile_size(v->tiles.Tm, tiles->Tm, TM);
+    uint64_t Tn = tile_size(v->tiles.Tn, tiles->Tn, TN);
+    uint64_t Tc = tile_size(v->tiles.Tc, tiles->Tc, TC);
+    uint64_t C_ofm = EXACT_TILES ? ROUND_UP(layer->C_ofm, Tc) : layer->C_ofm;
+
+    return layer->S_wts == 1 && layer->pad_top == 0 && layer->pad_left == 0 && layer->groups <= 1 &&
+           layer->K_wts <= LB_MAX_K && C_ofm + layer->K_wts - 1 <= LB_MAX_C &&
+           Tm <= LB_MAX_TM && Tn <= LB_MAX_TN;
+}
+
+int select_variant(const std::vector<kernel_variant> &variants, const layer_size *layer,
+                   const kernel_size *tiles, const int *loop_order) {
+    int best = -1;
+    size_t i;
+
+    for (i = 0; i < variants.size(); i++) {
+        const kernel_variant *v = &variants[i];
+
+        if (v->act_layout != ACT_LAYOUT || v->wts_layout != WTS_LAYOUT || v->exact_tiles != EXACT_TILES) {
+            continue;
+        }
+        // The blocked layouts index channels in blocks of this build's TM/TN
+        if ((ACT_LAYOUT == LAYOUT_NCHWc || WTS_LAYOUT != WLAYOUT_MNKK) &&
+            ((v->tiles.Tm && v->tiles.Tm != (uint64_t)TM) || (v->tiles.Tn && v->tiles.Tn != (uint64_t)TN))) {
+            printf("Kernel variant %s skipped: TM=%lu TN=%lu, the blocked layouts of this host use TM=%lu TN=%lu\n",
+                   v->prefix.c_str(), v->tiles.Tm, v->tiles.Tn, (uint64_t)TM, (uint64_t)TN);
+            continue;
+        }
+        // The packed weights of this host follow the to/ti nesting of its LOOP_ORDER
+        if (WTS_LAYOUT == WLAYOUT_PACKED && loop_ti_outer(v->loop_order) != (bool)WPACK_TI_OUTER) {
+            printf("Kernel variant %s skipped: its loop order nests %s, the packed weights of this host "
+                   "were built for LOOP_ORDER=%s\n", v->prefix.c_str(),
+                   loop_ti_outer(v->loop_order) ? "ti outside to" : "to outside ti", TILE_ORDER_STR(LOOP_ORDER));
+            continue;
+        }
+        if (v->engine == ENGINE_LINEBUF && !linebuf_fits(v, layer, tiles)) {
+            continue;
+        }
+        // Layer sizes are always known, fixed ones must match exactly
+        if (!(size_matches(v->layer.K_wts, layer->K_wts) && size_matches(v->layer.S_wts, layer->S_wts) &&
+              size_matches(v->layer.R_ofm, layer->R_ofm) && size_matches(v->layer.C_ofm, layer->C_ofm) &&
+              size_matches(v->layer.M_ofm, layer->M_ofm) && size_matches(v->layer.N_ifm, layer->N_ifm) &&
+              size_matches(v->layer.groups, layer->groups))) {
+            continue;
+        }
+        if (!(size_matches(v->tiles.Tr, tiles->Tr) && size_matches(v->tiles.Tc, tiles->Tc) &&
+              size_matches(v->tiles.Tm, tiles->Tm) && size_matches(v->tiles.Tn, tiles->Tn) &&
+              size_matches(v->tiles.Tb, tiles->Tb))) {
+            continue;
+        }
+        if (loop_order != NULL && memcmp(v->loop_order, loop_order, sizeof(v->loop_order)) != 0) {
+            continue;
+        }
+        // Ties go to the earlier line
+        if (best < 0 || v->num_fixed > variants[best].num_fixed) {
+            best = i;
+        }
+    }
+    return best;
+}
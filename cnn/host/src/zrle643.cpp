@@ -0,0 +1,187 @@
+
+/****************************************************************
+ * Copyright (c) 2020~2020, 18-643 Course Staff, CMU
+ * All rights reserved.
+
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ * The views and conclusions contained in the software and
+ * documentation are those of the authors and should not be
+ * interpreted as representing official policies, either expressed or
+ * implied, of the FreeBSD Project.
+ ****************************************************************/
+
+/*
+ * CMU 18643 Fall 2020 Lab Exercise
+ *
+ * Zero run-length activation transport, see zrle643.h
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include "zrle643.h"
+#include "layout643.h"
+
+// Blocks per unit of work; units run in parallel once the value offset
+// of each is known from the masks
+#define ZRLE_UNIT_BLOCKS 256
+
+typedef struct zrle_job {
+    const cnndata_t *src;
+    cnndata_t *dst;
+    unsigned *masks;
+    cnndata_t *vals;
+    uint64_t *offsets; // first value of each unit
+    uint64_t n, nb;
+} zrle_job;
+
+static uint64_t popcount_masks(const unsigned *masks, uint64_t begin, uint64_t end) {
+    uint64_t blk, count = 0;
+    for (blk = begin; blk < end; blk++) {
+        count += __builtin_popcount(masks[blk]);
+    }
+    return count;
+}
+
+// Masks of the blocks of units [begin, end), four elements per compare
+static void zrle_mask_units(uint64_t begin, uint64_t end, void *ctx) {
+    const zrle_job *job = (const zrle_job*)ctx;
+    const __m128 zero = _mm_setzero_ps();
+    uint64_t u, blk, k;
+
+    for (u = begin; u < end; u++) {
+        for (blk = u * ZRLE_UNIT_BLOCKS; blk < MIN((u + 1) * ZRLE_UNIT_BLOCKS, job->nb); blk++) {
+            const cnndata_t *x = &job->src[blk * ZRLE_BLOCK];
+            unsigned mask = 0;
+            if ((blk + 1) * ZRLE_BLOCK <= job->n) {
+                for (k = 0; k < ZRLE_BLOCK; k += 4) {
+                    mask |= (unsigned)_mm_movemask_ps(_mm_cmpneq_ps(_mm_loadu_ps(&x[k]), zero)) << k;
+                }
+            } else {
+                for (k = 0; k < job->n - blk * ZRLE_BLOCK; k++) {
+                    mask |= (unsigned)(x[k] != 0) << k;
+                }
+            }
+            job->masks[blk] = mask;
+        }
+    }
+}
+
+static void zrle_pack_units(uint64_t begin, uint64_t end, void *ctx) {
+    const zrle_job *job = (const zrle_job*)ctx;
+    uint64_t u, blk;
+
+    for (u = begin; u < end; u++) {
+        cnndata_t *v = &job->vals[job->offsets[u]];
+        for (blk = u * ZRLE_UNIT_BLOCKS; blk < MIN((u + 1) * ZRLE_UNIT_BLOCKS, job->nb); blk++) {
+            const cnndata_t *x = &job->src[blk * ZRLE_BLOCK];
+            unsigned mask = job->masks[blk];
+            while (mask) {
+                *v++ = x[__builtin_ctz(mask)];
+                mask &= mask - 1;
+            }
+        }
+    }
+}
+
+static void zrle_unpack_units(uint64_t begin, uint64_t end, void *ctx) {
+    const zrle_job *job = (const zrle_job*)ctx;
+    uint64_t u, blk;
+
+    for (u = begin; u < end; u++) {
+        const cnndata_t *v = &job->vals[job->offsets[u]];
+        for (blk = u * ZRLE_UNIT_BLOCKS; blk < MIN((u + 1) * ZRLE_UNIT_BLOCKS, job->nb); blk++) {
+            cnndata_t *x = &job->dst[blk * ZRLE_BLOCK];
+            uint64_t len = MIN((uint64_t)ZRLE_BLOCK, job->n - blk * ZRLE_BLOCK);
+            unsigned mask = job->masks[blk];
+            memset(x, 0, len * sizeof(cnndata_t));
+            while (mask) {
+                x[__builtin_ctz(mask)] = *v++;
+                mask &= mask - 1;
+            }
+        }
+    }
+}
+
+// Value offset of each unit from the mask popcounts, returns the total
+static uint64_t zrle_offsets(zrle_job *job, uint64_t num_units) {
+    uint64_t u, total = 0;
+    for (u = 0; u < num_units; u++) {
+        job->offsets[u] = total;
+        total += popcount_masks(job->masks, u * ZRLE_UNIT_BLOCKS, MIN((u + 1) * ZRLE_UNIT_BLOCKS, job->nb));
+    }
+    return total;
+}
+
+uint64_t zrle_encode(const cnndata_t *src, uint64_t n, cnndata_t *packed) {
+    zrle_job job;
+    uint64_t nnz, num_units;
+
+    job.src = src;
+    job.n = n;
+    job.nb = CEIL_DIV(n, ZRLE_BLOCK);
+    job.masks = (unsigned*)packed + 1;
+    job.vals = packed + ZRLE_HEADER(n);
+    num_units = CEIL_DIV(job.nb, ZRLE_UNIT_BLOCKS);
+    job.offsets = (uint64_t*)malloc(num_units * sizeof(uint64_t));
+    if (job.offsets == NULL) {
+        perror("Failed malloc of zero-RLE offsets");
+        exit(1);
+    }
+
+    parallel_for(num_units, zrle_mask_units, &job);
+    nnz = zrle_offsets(&job, num_units);
+    parallel_for(num_units, zrle_pack_units, &job);
+    ((unsigned*)packed)[0] = nnz;
+
+    free(job.offsets);
+    return ZRLE_HEADER(n) + nnz;
+}
+
+void zrle_decode(const cnndata_t *packed, uint64_t n, cnndata_t *dst) {
+    zrle_job job;
+    uint64_t num_units;
+
+    job.dst = dst;
+    job.n = n;
+    job.nb = CEIL_DIV(n, ZRLE_BLOCK);
+    job.masks = (unsigned*)packed + 1;
+    job.vals = (cnndata_t*)packed + ZRLE_HEADER(n);
+    num_units = CEIL_DIV(job.nb, ZRLE_UNIT_BLOCKS);
+    job.offsets = (uint64_t*)malloc(num_units * sizeof(uint64_t));
+    if (job.offsets == NULL) {
+        perror("Failed malloc of zero-RLE offsets");
+        exit(1);
+    }
+
+    zrle_offsets(&job, num_units);
+    parallel_for(num_units, zrle_unpack_units, &job);
+
+    free(job.offsets);
+}
@@ -0,0 +1,18 @@
+#!/bin/bash
+
+# Sets AOC_FLAGS for the kernel build from the variables the host
+# Makefile takes, so one setting builds the host and the kernel alike,
+# e.g. ACT_LAYOUT=2 NUM_CU=2 ./run_emulate.sh.  Flags already in
+# AOC_FLAGS are kept.  Sourced by build_fpga.sh and run_emulate.sh.
+
+KERNEL_VARS="ACT_LAYOUT WTS_LAYOUT EXACT_TILES CONV_ENGINE LOOP_ORDER GEMM_BS PW_BM PW_BQ SP_BN
+             NUM_CU JOB_TABLE JOBQ ZRLE
+             FIX_K FIX_S FIX_R FIX_C FIX_M FIX_N FIX_G FIX_P FIX_TR FIX_TC FIX_TM FIX_TN FIX_TB
+             K_WTS S_WTS R_OFM C_OFM M_OFM N_IFM G_GRP TR TC TM TN TB"
+
+for var in $KERNEL_VARS; do
+    if [ -n "${!var}" ]; then
+        AOC_FLAGS="$AOC_FLAGS -D$var=${!var}"
+        export $var
+    fi
+done
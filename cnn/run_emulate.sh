@@ -7,10 +7,17 @@ tools_setup -t A10DS
 # Move to project directory
 cd ~/lab1/
 
+# Kernel settings, also taken by make (see kernel_flags.sh)
+source ./kernel_flags.sh
+
 # Running project in Emulation mode
-printf "\\n%s\\n" "Running in Emulation Mode:"
-aoc -march=emulator -v device/cnn.cl -o bin/cnn.aocx
+printf "\\n%s\\n" "Running in Emulation Mode:$AOC_FLAGS"
+aoc -march=emulator -v $AOC_FLAGS device/cnn.cl -o bin/cnn.aocx
 make
 
 # Run host code for version 1.2.1
 ./bin/host -emulator
+
+# Tensor paths are relative to the calling directory, not bin/
+./bin/host -emulator -output=emulate_output.npy
+ls -l emulate_output.npy